@@ -0,0 +1,41 @@
+#include "benchmarks.h"
+
+#include <cstdlib>
+#include <new>
+
+// counts every allocation for the allocs/op and bytes/op columns
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size == 0 ? 1 : size)) {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+// kept out of line: inlined into a caller, GCC pairs that caller's new
+// expression with the free() here and reports a mismatched deallocation
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+int main() {
+    BenchmarkParallelBuild();
+    BenchmarkTermDictionary();
+    BenchmarkPostingLists();
+    BenchmarkIndexFile();
+    BenchmarkResultWriter();
+    BenchmarkMetrics();
+    BenchmarkComponents();
+    BenchmarkMaxScore();
+    BenchmarkQueryShards();
+    BenchmarkShardCoordinator();
+    BenchmarkTopK();
+    BenchmarkReordering();
+    BenchmarkMemoryUsage();
+    return 0;
+}
@@ -0,0 +1,765 @@
+#pragma once
+
+#include "profile.h"
+
+#include "search_server.h"
+#include "term_dictionary.h"
+#include "parse.h"
+#include "result_writer.h"
+#include "scoring.h"
+#include "segmented_index.h"
+#include "maxscore.h"
+#include "coordinator.h"
+
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::string InputDirectory() {
+    std::string input_dir = __FILE__;
+    return input_dir.substr(0, input_dir.find("benchmarks.h")) + "input/";
+}
+
+// Repo's sample books, concatenated `copies` times to get a sizeable base.
+std::string LoadSampleCorpus(size_t copies) {
+    const std::string input_dir = InputDirectory();
+
+    std::string books;
+    for (const char* name : {"file1.txt", "file2.txt"}) {
+        std::ifstream input(input_dir + name);
+        books.append(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+
+    std::string corpus;
+    corpus.reserve(books.size() * copies);
+    for (size_t i = 0; i < copies; ++i) {
+        corpus += books;
+    }
+    return corpus;
+}
+
+template<typename Func>
+double MeasureMilliseconds(Func func) {
+    const auto start = steady_clock::now();
+    func();
+    return duration<double, std::milli>(steady_clock::now() - start).count();
+}
+
+// Calls of operator new and the bytes they asked for, counted by the replacement in bench.cpp.
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> allocated_bytes{0};
+
+// Prints "name: X ns/op, Y allocs/op, Z bytes/op" for `ops` operations done by `func`.
+template<typename Func>
+void ReportPerOp(const std::string& name, size_t ops, Func func) {
+    const size_t allocations_before = allocations.load();
+    const size_t bytes_before = allocated_bytes.load();
+    const double ms = MeasureMilliseconds(func);
+    const size_t count = allocations.load() - allocations_before;
+    const size_t bytes = allocated_bytes.load() - bytes_before;
+    std::cout << "    " << name << ": " << ms * 1e6 / ops << " ns/op, "
+              << static_cast<double>(count) / ops << " allocs/op, "
+              << static_cast<double>(bytes) / ops << " bytes/op" << std::endl;
+}
+
+// Ranks 0..n-1 with P(rank) proportional to 1 / (rank + 1)^s. Draws come
+// from a fixed-seed engine and an explicit inverse CDF, so every platform
+// generates the same sequence.
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n, double s, uint64_t seed) :
+            gen(seed)
+    {
+        cdf.reserve(n);
+        double sum = 0;
+        for (size_t rank = 0; rank < n; ++rank) {
+            sum += 1 / std::pow(rank + 1, s);
+            cdf.push_back(sum);
+        }
+        for (double& value : cdf) {
+            value /= sum;
+        }
+    }
+
+    size_t Next() {
+        const double u = (gen() >> 11) * 0x1.0p-53;
+        return std::min<size_t>(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin(), cdf.size() - 1);
+    }
+
+private:
+    std::mt19937_64 gen;
+    std::vector<double> cdf;
+};
+
+// `lines` lines of 1 to 2 * `words_per_line` words; word "w<rank>" follows Zipf's law.
+std::string MakeZipfText(size_t lines, size_t words_per_line, size_t vocabulary, uint64_t seed) {
+    ZipfGenerator words(vocabulary, 1.0, seed);
+    std::mt19937_64 lengths(seed + 1);
+    std::string text;
+    for (size_t line = 0; line < lines; ++line) {
+        for (size_t i = 1 + lengths() % (2 * words_per_line); i > 0; --i) {
+            text += 'w';
+            text += std::to_string(words.Next());
+            text += i > 1 ? ' ' : '\n';
+        }
+    }
+    return text;
+}
+
+void BenchmarkParallelBuild() {
+    const std::string corpus = LoadSampleCorpus(20);
+    std::cout << "InvertedIndex build, " << corpus.size() / 1024 / 1024 << " MiB corpus" << std::endl;
+
+    const size_t max_threads = std::max(2u, 2 * std::thread::hardware_concurrency());
+    double sequential_ms = 0;
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        std::istringstream document_input(corpus);
+        const double ms = MeasureMilliseconds([&] {
+            InvertedIndex index(document_input, {threads});
+        });
+        if (threads == 1) {
+            sequential_ms = ms;
+        }
+        std::cout << "  threads: " << threads
+                  << ", " << ms << " ms"
+                  << ", speedup: " << sequential_ms / ms << std::endl;
+    }
+}
+
+
+void BenchmarkTermDictionary() {
+    const std::string corpus = LoadSampleCorpus(1);
+    const std::vector<std::string_view> tokens = SplitIntoWordsView(corpus);
+    std::cout << "Term dictionary, " << tokens.size() << " tokens" << std::endl;
+
+    std::map<std::string_view, uint32_t> map;
+    const double map_insert_ms = MeasureMilliseconds([&] {
+        for (auto token : tokens) {
+            map.emplace(token, static_cast<uint32_t>(map.size()));
+        }
+    });
+    uint64_t map_checksum = 0;
+    const double map_find_ms = MeasureMilliseconds([&] {
+        for (auto token : tokens) {
+            map_checksum += map.find(token)->second;
+        }
+    });
+
+    TermDictionary dictionary;
+    const double dictionary_insert_ms = MeasureMilliseconds([&] {
+        for (auto token : tokens) {
+            dictionary.Insert(token);
+        }
+    });
+    uint64_t dictionary_checksum = 0;
+    const double dictionary_find_ms = MeasureMilliseconds([&] {
+        for (auto token : tokens) {
+            dictionary_checksum += dictionary.Find(token);
+        }
+    });
+
+    const double to_ns_per_op = 1e6 / tokens.size();
+    std::cout << "  std::map insert: " << map_insert_ms * to_ns_per_op << " ns/op"
+              << ", find: " << map_find_ms * to_ns_per_op << " ns/op" << std::endl;
+    std::cout << "  TermDictionary insert: " << dictionary_insert_ms * to_ns_per_op << " ns/op"
+              << ", find: " << dictionary_find_ms * to_ns_per_op << " ns/op" << std::endl;
+    std::cout << "  " << map.size() << " terms, checksums "
+              << (map_checksum == dictionary_checksum ? "match" : "differ") << std::endl;
+}
+
+
+void BenchmarkPostingLists() {
+    const std::string corpus = LoadSampleCorpus(4);
+    std::istringstream plain_input(corpus);
+    std::istringstream compressed_input(corpus);
+    const InvertedIndex plain(plain_input);
+    const InvertedIndex compressed(compressed_input, {1, true});
+    // one vector per posting list, as before freezing
+    const InvertedIndex growing = [&corpus] {
+        InvertedIndex result;
+        for (auto line : SplitBy(corpus, '\n')) {
+            result.Add(std::string(line));
+        }
+        return result;
+    }();
+
+    TermDictionary vocabulary;
+    for (auto word : SplitIntoWordsView(corpus)) {
+        vocabulary.Insert(word);
+    }
+    size_t plain_bytes = 0;
+    size_t compressed_bytes = 0;
+    for (uint32_t term_id = 0; term_id < vocabulary.Size(); ++term_id) {
+        plain_bytes += plain.Lookup(vocabulary.Term(term_id)).MemoryBytes();
+        compressed_bytes += compressed.Lookup(vocabulary.Term(term_id)).MemoryBytes();
+    }
+    std::cout << "Posting lists, " << corpus.size() / 1024 / 1024 << " MiB corpus" << std::endl;
+    std::cout << "  plain: " << plain_bytes / 1024 << " KiB"
+              << ", compressed: " << compressed_bytes / 1024 << " KiB" << std::endl;
+
+    const size_t ROUNDS = 200;
+    for (const InvertedIndex* index : {&growing, &plain, &compressed}) {
+        size_t postings = 0;
+        size_t checksum = 0;
+        const double ms = MeasureMilliseconds([&] {
+            for (size_t round = 0; round < ROUNDS; ++round) {
+                for (const char* word : {"the", "of", "and"}) {
+                    const PostingList list = index->Lookup(word);
+                    list.ForEach([&checksum](size_t docid, size_t hits) {
+                        checksum += docid + hits;
+                    });
+                    postings += list.Size();
+                }
+            }
+        });
+        const char* name = index == &growing ? "vectors" : index == &plain ? "frozen" : "compressed";
+        std::cout << "  " << name << " traversal: "
+                  << postings / ms / 1000 << " M postings/s (checksum " << checksum << ")" << std::endl;
+    }
+
+    // every list once, most of them short: the cost is in reaching the list
+    for (const InvertedIndex* index : {&growing, &plain}) {
+        size_t postings = 0;
+        size_t checksum = 0;
+        const double ms = MeasureMilliseconds([&] {
+            for (size_t round = 0; round < 10; ++round) {
+                for (uint32_t term_id = 0; term_id < vocabulary.Size(); ++term_id) {
+                    const PostingList list = index->Lookup(vocabulary.Term(term_id));
+                    list.ForEach([&checksum](size_t docid, size_t hits) {
+                        checksum += docid + hits;
+                    });
+                    postings += list.Size();
+                }
+            }
+        });
+        std::cout << "  " << (index == &growing ? "vectors" : "frozen") << ", all lists: "
+                  << postings / ms / 1000 << " M postings/s (checksum " << checksum << ")" << std::endl;
+    }
+}
+
+
+void BenchmarkIndexFile() {
+    const std::string corpus = LoadSampleCorpus(20);
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_bench.idx").string();
+    std::cout << "Index startup, " << corpus.size() / 1024 / 1024 << " MiB corpus" << std::endl;
+
+    std::istringstream document_input(corpus);
+    InvertedIndex built;
+    const double build_ms = MeasureMilliseconds([&] {
+        built = InvertedIndex(document_input);
+    });
+    const double save_ms = MeasureMilliseconds([&] {
+        built.Save(path);
+    });
+    const double verified_map_ms = MeasureMilliseconds([&] {
+        InvertedIndex::Map(path);
+    });
+    const double map_ms = MeasureMilliseconds([&] {
+        InvertedIndex::Map(path, false);
+    });
+
+    std::cout << "  build from text: " << build_ms << " ms, save: " << save_ms << " ms" << std::endl;
+    std::cout << "  map with checksum: " << verified_map_ms << " ms, without: " << map_ms << " ms" << std::endl;
+
+    // out-of-core build straight into the file, batches spilled as sorted runs
+    for (size_t memory_limit : {size_t(4) << 20, size_t(64) << 20}) {
+        ExternalBuildOptions options;
+        options.memory_limit = memory_limit;
+        std::istringstream external_input(corpus);
+        const double ms = MeasureMilliseconds([&] {
+            InvertedIndex::BuildFile(external_input, path, options);
+        });
+        std::cout << "  build to file in " << (options.memory_limit >> 20) << " MiB batches: " << ms << " ms" << std::endl;
+    }
+    std::filesystem::remove(path);
+}
+
+
+void BenchmarkResultWriter() {
+    std::mt19937 gen(5);
+    std::vector<std::vector<Item>> answers(100000);
+    for (auto& top_docs : answers) {
+        for (size_t i = gen() % 6; i > 0; --i) {
+            top_docs.push_back({gen() % 1000000, 1 + gen() % 1000});
+        }
+    }
+    const std::string query = "some query words";
+    std::cout << "Result formatting, " << answers.size() << " answers" << std::endl;
+
+    std::ostringstream stream_output;
+    const double stream_ms = MeasureMilliseconds([&] {
+        for (const auto& top_docs : answers) {
+            stream_output << query << ':';
+            for (auto [docid, hitcount] : top_docs) {
+                stream_output << " {" << "docid: " << docid << ", " << "hitcount: " << hitcount << '}';
+            }
+            stream_output << '\n';
+        }
+    });
+
+    ResultWriter writer;
+    const double writer_ms = MeasureMilliseconds([&] {
+        for (const auto& top_docs : answers) {
+            writer.Write(query, top_docs);
+        }
+    });
+
+    ResultWriter binary_writer(ResultFormat::BINARY);
+    const double binary_ms = MeasureMilliseconds([&] {
+        for (const auto& top_docs : answers) {
+            binary_writer.Write(query, top_docs);
+        }
+    });
+
+    const double to_ns_per_answer = 1e6 / answers.size();
+    std::cout << "  ostringstream: " << stream_ms * to_ns_per_answer << " ns/answer" << std::endl;
+    std::cout << "  ResultWriter text: " << writer_ms * to_ns_per_answer << " ns/answer"
+              << (writer.Data() == stream_output.str() ? "" : ", OUTPUT DIFFERS") << std::endl;
+    std::cout << "  ResultWriter binary: " << binary_ms * to_ns_per_answer << " ns/answer"
+              << ", " << binary_writer.Data().size() << " bytes vs " << writer.Data().size() << std::endl;
+}
+
+
+void BenchmarkMetrics() {
+    const size_t samples = 10000000;
+    std::cout << "Metrics, " << samples << " samples" << std::endl;
+
+    Metrics metrics;
+    const double add_ms = MeasureMilliseconds([&] {
+        for (size_t i = 0; i < samples; ++i) {
+            metrics.Add(Counter::QUERIES);
+        }
+    });
+    const double record_ms = MeasureMilliseconds([&] {
+        for (size_t i = 0; i < samples; ++i) {
+            metrics.Record(Phase::LOOKUP, nanoseconds(i % 100000));
+        }
+    });
+    const double timer_ms = MeasureMilliseconds([&] {
+        for (size_t i = 0; i < samples; ++i) {
+            RECORD_DURATION(metrics, Phase::TOP_K);
+        }
+    });
+
+    const double to_ns_per_op = 1e6 / samples;
+    std::cout << "  counter add: " << add_ms * to_ns_per_op << " ns/op"
+              << ", histogram record: " << record_ms * to_ns_per_op << " ns/op"
+              << ", timed scope: " << timer_ms * to_ns_per_op << " ns/op" << std::endl;
+    std::cout << "  " << metrics.Read().ToJson() << std::endl;
+}
+
+
+void BenchmarkComponents() {
+    const size_t VOCABULARY = 100000;
+    const size_t MAX_DOCS = 5;
+    const std::string queries_text = MakeZipfText(2000, 2, VOCABULARY, 7);
+    const std::vector<std::string_view> queries = SplitBy(queries_text, '\n');
+    size_t query_words_num = 0;
+    for (auto query : queries) {
+        ForEachWord(query, [&](std::string_view) { ++query_words_num; });
+    }
+
+    for (size_t docs_num : {10000, 100000}) {
+        const std::string corpus = MakeZipfText(docs_num, 20, VOCABULARY, 1);
+        const std::vector<std::string_view> lines = SplitBy(corpus, '\n');
+        size_t words_num = 0;
+        for (auto line : lines) {
+            ForEachWord(line, [&](std::string_view) { ++words_num; });
+        }
+        std::cout << "Components, Zipf corpus of " << docs_num << " documents, " << words_num << " words, "
+                  << queries.size() << " queries" << std::endl;
+
+        size_t checksum = 0;
+        std::cout << "  per word" << std::endl;
+        ReportPerOp("SplitIntoWordsView", words_num, [&] {
+            for (auto line : lines) {
+                checksum += SplitIntoWordsView(line).size();
+            }
+        });
+        ReportPerOp("ForEachWord", words_num, [&] {
+            for (auto line : lines) {
+                ForEachWord(line, [&](std::string_view word) { checksum += word.size(); });
+            }
+        });
+
+        std::cout << "  per document" << std::endl;
+        for (size_t threads : {1, 2, 4}) {
+            ReportPerOp("InvertedIndex build, " + std::to_string(threads) + " threads", docs_num, [&] {
+                std::istringstream document_input(corpus);
+                checksum += InvertedIndex(document_input, {threads}).GetDocsSize();
+            });
+        }
+
+        std::istringstream document_input(corpus);
+        const SegmentedIndex index{InvertedIndex(document_input)};
+        const InvertedIndex& segment = *index.GetSegments().front().index;
+
+        std::cout << "  per query word" << std::endl;
+        ReportPerOp("Lookup", query_words_num, [&] {
+            for (auto query : queries) {
+                ForEachWord(query, [&](std::string_view word) { checksum += segment.Lookup(word).Size(); });
+            }
+        });
+
+        std::cout << "  per query" << std::endl;
+        HitAccumulator accumulator;
+        auto score = [&](std::string_view query) {
+            accumulator.Reset(index.GetDocsSize());
+            ForEachWord(query, [&](std::string_view word) { index.AddHits(word, accumulator); });
+        };
+        ReportPerOp("scoring", queries.size(), [&] {
+            for (auto query : queries) {
+                score(query);
+                checksum += accumulator.Touched().size();
+            }
+        });
+        ReportPerOp("scoring + SelectTopDocs", queries.size(), [&] {
+            for (auto query : queries) {
+                score(query);
+                checksum += SelectTopDocs(accumulator, MAX_DOCS).size();
+            }
+        });
+
+        std::vector<std::vector<Item>> candidates;
+        for (auto query : queries) {
+            score(query);
+            auto& items = candidates.emplace_back();
+            for (size_t docid : accumulator.Touched()) {
+                items.push_back({docid, accumulator.Hits(docid)});
+            }
+        }
+        std::vector<Item> buffer;
+        buffer.reserve(index.GetDocsSize());
+        ReportPerOp("partial_sort top-5 of scored documents", queries.size(), [&] {
+            for (const auto& items : candidates) {
+                buffer.assign(items.begin(), items.end());
+                const auto middle = buffer.begin() + std::min(buffer.size(), size_t(MAX_DOCS));
+                std::partial_sort(buffer.begin(), middle, buffer.end(), IsBetterHit);
+                checksum += buffer.empty() ? 0 : buffer.front().docid;
+            }
+        });
+        std::cout << "  checksum " << checksum << std::endl;
+    }
+}
+
+
+void BenchmarkMaxScore() {
+    const size_t MAX_DOCS = 5;
+    const std::string corpus = MakeZipfText(100000, 20, 100000, 1);
+    const std::string queries_text = MakeZipfText(2000, 2, 100000, 7);
+    const std::vector<std::string_view> queries = SplitBy(queries_text, '\n');
+    std::cout << "Top-5 selection, Zipf corpus of 100000 documents, " << queries.size() << " queries" << std::endl;
+
+    for (bool compress : {false, true}) {
+        std::istringstream document_input(corpus);
+        const SegmentedIndex index{InvertedIndex(document_input, {1, compress})};
+        std::vector<std::vector<std::string_view>> words;
+        for (auto query : queries) {
+            words.push_back(SplitIntoWordsView(query));
+        }
+
+        HitAccumulator accumulator;
+        std::vector<std::vector<Item>> exhaustive(queries.size());
+        const double exhaustive_ms = MeasureMilliseconds([&] {
+            for (size_t i = 0; i < words.size(); ++i) {
+                accumulator.Reset(index.GetDocsSize());
+                for (auto word : words[i]) {
+                    index.AddHits(word, accumulator);
+                }
+                exhaustive[i] = SelectTopDocs(accumulator, MAX_DOCS);
+            }
+        });
+
+        bool same = true;
+        const double pruned_ms = MeasureMilliseconds([&] {
+            for (size_t i = 0; i < words.size(); ++i) {
+                const auto top = SelectTopDocsMaxScore(index, words[i], MAX_DOCS);
+                same = same && top.size() == exhaustive[i].size()
+                       && std::equal(top.begin(), top.end(), exhaustive[i].begin(), [](const Item& lhs, const Item& rhs) {
+                           return lhs.docid == rhs.docid && lhs.hits == rhs.hits;
+                       });
+            }
+        });
+
+        std::cout << "  " << (compress ? "compressed" : "plain") << " postings"
+                  << ", exhaustive: " << exhaustive_ms * 1000 / queries.size() << " us/query"
+                  << ", MaxScore: " << pruned_ms * 1000 / queries.size() << " us/query"
+                  << (same ? "" : ", RESULTS DIFFER") << std::endl;
+    }
+}
+
+
+void BenchmarkQueryShards() {
+    const std::string corpus = MakeZipfText(200000, 20, 100000, 1);
+    const std::string queries_text = MakeZipfText(300, 4, 100000, 7);
+    const std::vector<std::string_view> queries = SplitBy(queries_text, '\n');
+    std::cout << "Single query latency, Zipf corpus of 200000 documents, " << queries.size() << " queries, "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+    std::string expected;
+    for (size_t shards : {1, 2, 4, 8}) {
+        SearchServerOptions options;
+        options.query_shards = shards;
+        options.query_cache_capacity = 0;
+        std::istringstream document_input(corpus);
+        SearchServer srv(document_input, options);
+
+        // one query at a time, so nothing but the shards runs in parallel
+        std::ostringstream output;
+        const double ms = MeasureMilliseconds([&] {
+            for (auto query : queries) {
+                std::istringstream query_input{std::string(query)};
+                srv.AddQueriesStream(query_input, output);
+                srv.Synchronize();
+            }
+        });
+        if (shards == 1) {
+            expected = output.str();
+        }
+        std::cout << "  " << shards << " shards: " << ms * 1000 / queries.size() << " us/query"
+                  << (output.str() == expected ? "" : ", RESULTS DIFFER") << std::endl;
+    }
+}
+
+
+void BenchmarkShardCoordinator() {
+    const std::string corpus = MakeZipfText(200000, 20, 100000, 1);
+    const std::string queries = MakeZipfText(20000, 4, 100000, 7);
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_bench_shards.txt").string();
+    std::ofstream(path) << corpus;
+    std::cout << "Shard processes, Zipf corpus of 200000 documents, 20000 queries in one stream" << std::endl;
+
+    std::string expected;
+    {
+        SearchServerOptions options;
+        options.query_cache_capacity = 0;
+        std::istringstream document_input(corpus);
+        SearchServer srv(document_input, options);
+        std::istringstream query_input(queries);
+        std::ostringstream output;
+        const double ms = MeasureMilliseconds([&] {
+            srv.AddQueriesStream(query_input, output);
+            srv.Synchronize();
+        });
+        expected = output.str();
+        std::cout << "  one process: " << 20000 / ms << "k queries/s" << std::endl;
+    }
+
+    // the server above is gone: shards are forked from a process without threads
+    for (size_t shards : {1, 2, 4}) {
+        ShardCoordinatorOptions options;
+        options.shards = shards;
+        options.server.query_cache_capacity = 0;
+        ShardCoordinator coordinator(path, options);
+        std::istringstream query_input(queries);
+        std::ostringstream output;
+        const double ms = MeasureMilliseconds([&] {
+            coordinator.AddQueriesStream(query_input, output);
+        });
+        std::cout << "  " << shards << " shards: " << 20000 / ms << "k queries/s"
+                  << (output.str() == expected ? "" : ", RESULTS DIFFER") << std::endl;
+    }
+    std::filesystem::remove(path);
+}
+
+
+// IsBetterHit that counts its calls
+struct CountingBetterHit {
+    size_t* comparisons;
+
+    bool operator()(const Item& lhs, const Item& rhs) const {
+        ++*comparisons;
+        return IsBetterHit(lhs, rhs);
+    }
+};
+
+// Prints ns and comparisons per query for the selector make_selector(better)
+// fed with the candidates of every query; comparisons are counted in a separate pass.
+template<typename MakeSelector>
+void ReportSelector(const std::string& name, const std::vector<std::vector<Item>>& candidates,
+                    MakeSelector make_selector) {
+    size_t comparisons = 0;
+    for (const auto& items : candidates) {
+        auto selector = make_selector(CountingBetterHit{&comparisons});
+        for (const Item& candidate : items) {
+            selector.Offer(candidate);
+        }
+    }
+
+    size_t checksum = 0;
+    std::vector<Item> top;
+    const double ms = MeasureMilliseconds([&] {
+        for (const auto& items : candidates) {
+            auto selector = make_selector(BetterHit());
+            for (const Item& candidate : items) {
+                selector.Offer(candidate);
+            }
+            top.clear();
+            selector.AppendTo(top);
+            checksum += top.empty() ? 0 : top.back().docid;
+        }
+    });
+    std::cout << "    " << name << ": " << ms * 1e6 / candidates.size() << " ns/query, "
+              << static_cast<double>(comparisons) / candidates.size() << " comparisons/query"
+              << " (checksum " << checksum << ")" << std::endl;
+}
+
+template<size_t K>
+void ReportTopK(const std::vector<std::vector<Item>>& candidates) {
+    std::cout << "  k = " << K << std::endl;
+    ReportSelector("FixedTopK", candidates, [](auto better) {
+        return FixedTopK<K, decltype(better)>(better);
+    });
+    ReportSelector("heap", candidates, [](auto better) {
+        return HeapTopK<decltype(better)>(K, better);
+    });
+}
+
+
+void BenchmarkTopK() {
+    const std::string corpus = MakeZipfText(100000, 20, 100000, 1);
+    const std::string queries_text = MakeZipfText(2000, 2, 100000, 7);
+    std::istringstream document_input(corpus);
+    const SegmentedIndex index{InvertedIndex(document_input)};
+
+    // scored documents of every query in the order the accumulator touched them
+    std::vector<std::vector<Item>> candidates;
+    size_t candidates_num = 0;
+    HitAccumulator accumulator;
+    for (auto query : SplitBy(queries_text, '\n')) {
+        accumulator.Reset(index.GetDocsSize());
+        ForEachWord(query, [&](std::string_view word) { index.AddHits(word, accumulator); });
+        auto& items = candidates.emplace_back();
+        for (size_t docid : accumulator.Touched()) {
+            items.push_back({docid, accumulator.Hits(docid)});
+        }
+        candidates_num += items.size();
+    }
+    std::cout << "Top-k selection, Zipf corpus of 100000 documents, " << candidates.size() << " queries, "
+              << candidates_num / candidates.size() << " scored documents per query" << std::endl;
+
+    ReportTopK<1>(candidates);
+    ReportTopK<5>(candidates);
+    ReportTopK<10>(candidates);
+    ReportTopK<20>(candidates);
+    std::cout << "  k = 100" << std::endl;
+    ReportSelector("heap", candidates, [](auto better) {
+        return HeapTopK<decltype(better)>(100, better);
+    });
+}
+
+
+void BenchmarkReordering() {
+    for (size_t copies : {1, 4}) {
+        const std::string corpus = LoadSampleCorpus(copies);
+        // lines of the books as queries: many terms, most documents tie
+        std::string queries;
+        size_t queries_num = 0;
+        const std::vector<std::string_view> lines = SplitBy(corpus, '\n');
+        for (size_t i = 0; i < lines.size() && queries_num < 500; i += 37, ++queries_num) {
+            queries += lines[i];
+            queries += '\n';
+        }
+        TermDictionary vocabulary;
+        for (auto word : SplitIntoWordsView(corpus)) {
+            vocabulary.Insert(word);
+        }
+        std::cout << "Document reordering, " << lines.size() << " documents" << std::endl;
+
+        std::string expected;
+        for (bool reorder : {false, true}) {
+            IndexBuildOptions build_options;
+            build_options.threads = 1;
+            build_options.compress_postings = true;
+            build_options.reorder_documents = reorder;
+            std::istringstream compressed_input(corpus);
+            std::optional<InvertedIndex> compressed;
+            const double build_ms = MeasureMilliseconds([&] {
+                compressed.emplace(compressed_input, build_options);
+            });
+
+            // what an entropy coder of the docid gaps would need, against the block format
+            double gap_bits = 0;
+            size_t compressed_bytes = 0;
+            for (uint32_t term_id = 0; term_id < vocabulary.Size(); ++term_id) {
+                const PostingList list = compressed->Lookup(vocabulary.Term(term_id));
+                size_t previous = 0;
+                list.ForEach([&](size_t docid, size_t) {
+                    gap_bits += std::log2(docid - previous + 1.0);
+                    previous = docid;
+                });
+                compressed_bytes += list.MemoryBytes();
+            }
+
+            SearchServerOptions options;
+            options.threads = 1;
+            options.query_cache_capacity = 0;
+            options.index_build = build_options;
+            options.index_build.compress_postings = false;
+            std::istringstream document_input(corpus);
+            SearchServer srv(document_input, options);
+            std::ostringstream output;
+            const double query_ms = MeasureMilliseconds([&] {
+                std::istringstream query_input(queries);
+                srv.AddQueriesStream(query_input, output);
+                srv.Synchronize();
+            });
+            if (!reorder) {
+                expected = output.str();
+            }
+            std::cout << "  " << (reorder ? "reordered" : "input order") << ": build " << build_ms << " ms"
+                      << ", log2 gaps " << static_cast<size_t>(gap_bits / 8 / 1024) << " KiB"
+                      << ", compressed postings " << compressed_bytes / 1024 << " KiB"
+                      << ", " << query_ms * 1000 / queries_num << " us/query"
+                      << (output.str() == expected ? "" : ", RESULTS DIFFER") << std::endl;
+        }
+    }
+}
+
+
+void BenchmarkMemoryUsage() {
+    const std::string corpus = LoadSampleCorpus(20);
+    std::cout << "Memory usage, " << corpus.size() / 1024 << " KiB corpus" << std::endl;
+    auto report = [](const std::string& name, const IndexMemoryUsage& usage) {
+        std::cout << "  " << name << ": dictionary " << usage.dictionary / 1024 << " KiB"
+                  << ", postings " << usage.postings / 1024 << " KiB"
+                  << ", documents " << usage.documents / 1024 << " KiB"
+                  << ", total " << usage.Total() / 1024 << " KiB"
+                  << ", mapped " << usage.mapped / 1024 << " KiB" << std::endl;
+    };
+
+    for (bool compress : {false, true}) {
+        std::istringstream document_input(corpus);
+        report(compress ? "compressed" : "frozen", InvertedIndex(document_input, {1, compress}).GetMemoryUsage());
+    }
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_bench_memory.idx").string();
+    {
+        std::istringstream document_input(corpus);
+        InvertedIndex(document_input).Save(path);
+    }
+    report("mapped", InvertedIndex::Map(path).GetMemoryUsage());
+    std::filesystem::remove(path);
+
+    SearchServerOptions options;
+    options.threads = 4;
+    std::istringstream document_input(corpus);
+    SearchServer srv(document_input, options);
+    std::istringstream query_input(MakeZipfText(2000, 3, 1000, 3));
+    std::ostringstream output;
+    srv.AddQueriesStream(query_input, output);
+    srv.Synchronize();
+    const ServerMemoryUsage usage = srv.GetMemoryUsage();
+    std::cout << "  server after 2000 queries on 4 workers: query scratch " << usage.query_scratch / 1024
+              << " KiB, query cache " << usage.query_cache / 1024 << " KiB, total " << usage.Total() / 1024
+              << " KiB" << std::endl;
+}
@@ -0,0 +1,294 @@
+#include "coordinator.h"
+#include "scoring.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// query lines sent to the shards at a time
+const size_t EXCHANGE_LINES = 1024;
+
+const size_t READ_SIZE = 1 << 16;
+
+std::runtime_error SystemError(const std::string& what) {
+    return std::runtime_error("ShardCoordinator: " + what + ": " + std::strerror(errno));
+}
+
+bool WriteAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        const ssize_t count = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(count);
+    }
+    return true;
+}
+
+// Shard side: answers every batch of complete query lines arriving on `fd`
+// until the coordinator closes its end.
+void ServeQueries(int fd, SearchServer& server) {
+    std::string input;
+    char buffer[READ_SIZE];
+    while (true) {
+        const ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return;
+        }
+        input.append(buffer, count);
+        const size_t end = input.rfind('\n');
+        if (end == std::string::npos) {
+            continue;
+        }
+
+        std::istringstream query_input(input.substr(0, end + 1));
+        input.erase(0, end + 1);
+        std::ostringstream answers;
+        server.AddQueriesStream(query_input, answers);
+        server.Synchronize();
+        if (!WriteAll(fd, answers.str())) {
+            return;
+        }
+    }
+}
+
+// Body of a shard process: indexes lines [first, first + count) of the file
+// and serves them on `fd`. Never returns into the caller's code.
+[[noreturn]] void RunShard(int fd, const std::string& documents_path, size_t first, size_t count,
+                           SearchServerOptions options) {
+    int status = 0;
+    try {
+        std::ifstream input(documents_path);
+        std::string documents;
+        std::string line;
+        for (size_t docid = 0; docid < first + count && std::getline(input, line); ++docid) {
+            if (docid >= first) {
+                documents += line;
+                documents += '\n';
+            }
+        }
+
+        options.result_format = ResultFormat::BINARY;
+        std::istringstream document_input(documents);
+        documents.clear();
+        documents.shrink_to_fit();
+        SearchServer server(document_input, options);
+        ServeQueries(fd, server);
+    } catch (...) {
+        status = 1;
+    }
+    // skips the destructors and exit handlers of the copied parent process
+    _exit(status);
+}
+
+uint32_t ReadUint32(const std::string& data, size_t offset) {
+    uint32_t value = 0;
+    for (int byte = 0; byte < 4; ++byte) {
+        value |= uint32_t(static_cast<unsigned char>(data[offset + byte])) << (8 * byte);
+    }
+    return value;
+}
+
+// moves `offset` past the complete binary answers in `data`, counting them in `answered`
+void SkipAnswers(const std::string& data, size_t& offset, size_t& answered) {
+    while (data.size() - offset >= sizeof(uint32_t)) {
+        const size_t size = sizeof(uint32_t) + 2 * sizeof(uint32_t) * ReadUint32(data, offset);
+        if (data.size() - offset < size) {
+            return;
+        }
+        offset += size;
+        ++answered;
+    }
+}
+
+}  // namespace
+
+ShardCoordinator::ShardCoordinator(const std::string& documents_path, const ShardCoordinatorOptions& options) :
+        result_format(options.server.result_format),
+        max_results(options.server.max_results)
+{
+    if (options.shards == 0) {
+        throw std::logic_error("ShardCoordinator: at least one shard is needed");
+    }
+    std::ifstream input(documents_path);
+    if (!input) {
+        throw std::runtime_error("ShardCoordinator: cannot open " + documents_path);
+    }
+    for (std::string line; std::getline(input, line); ) {
+        ++docs_num;
+    }
+
+    const size_t range_size = (docs_num + options.shards - 1) / options.shards;
+    try {
+        for (size_t i = 0; i < options.shards; ++i) {
+            const size_t first = std::min(i * range_size, docs_num);
+            const size_t last = std::min(first + range_size, docs_num);
+
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+                throw SystemError("cannot create a socketpair");
+            }
+            const pid_t pid = fork();
+            if (pid < 0) {
+                close(fds[0]);
+                close(fds[1]);
+                throw SystemError("cannot fork a shard");
+            }
+            if (pid == 0) {
+                // a shard keeps only its own end of its own connection, so it
+                // sees the end of input when the coordinator closes it
+                close(fds[0]);
+                for (const Shard& shard : shards) {
+                    close(shard.fd);
+                }
+                RunShard(fds[1], documents_path, first, last - first, options.server);
+            }
+            close(fds[1]);
+            shards.push_back({pid, fds[0], first});
+        }
+    } catch (...) {
+        Shutdown();
+        throw;
+    }
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    Shutdown();
+}
+
+void ShardCoordinator::Shutdown() {
+    for (const Shard& shard : shards) {
+        close(shard.fd);
+    }
+    for (const Shard& shard : shards) {
+        while (waitpid(shard.pid, nullptr, 0) < 0 && errno == EINTR) {
+        }
+    }
+    shards.clear();
+}
+
+void ShardCoordinator::AddQueriesStream(std::istream& query_input, std::ostream& search_results_output) {
+    std::vector<std::string> queries;
+    std::string requests;
+    std::vector<std::string> answers;
+    std::vector<size_t> offsets;
+    std::vector<Item> top_docs;
+    ResultWriter writer(result_format);
+
+    while (true) {
+        queries.clear();
+        requests.clear();
+        for (std::string line; queries.size() < EXCHANGE_LINES && std::getline(query_input, line); ) {
+            requests += line;
+            requests += '\n';
+            queries.push_back(std::move(line));
+        }
+        if (queries.empty()) {
+            return;
+        }
+        Exchange(requests, queries.size(), answers);
+
+        // the global top is within the union of the shard tops
+        writer.Reset(result_format);
+        offsets.assign(shards.size(), 0);
+        for (const std::string& query : queries) {
+            top_docs.clear();
+            for (size_t i = 0; i < shards.size(); ++i) {
+                const std::string& data = answers[i];
+                const uint32_t count = ReadUint32(data, offsets[i]);
+                offsets[i] += sizeof(uint32_t);
+                for (uint32_t j = 0; j < count; ++j, offsets[i] += 2 * sizeof(uint32_t)) {
+                    top_docs.push_back({shards[i].first_docid + ReadUint32(data, offsets[i]),
+                                        ReadUint32(data, offsets[i] + sizeof(uint32_t))});
+                }
+            }
+            const auto middle = top_docs.begin() + std::min(top_docs.size(), max_results);
+            std::partial_sort(top_docs.begin(), middle, top_docs.end(), IsBetterHit);
+            top_docs.erase(middle, top_docs.end());
+            writer.Write(query, top_docs);
+        }
+        const std::string_view data = writer.Data();
+        search_results_output.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+}
+
+void ShardCoordinator::Exchange(std::string_view requests, size_t queries_num, std::vector<std::string>& answers) {
+    struct Progress {
+        size_t written = 0;   // bytes of `requests` sent
+        size_t parsed = 0;    // bytes of complete answers received
+        size_t answered = 0;  // complete answers received
+    };
+    std::vector<Progress> progress(shards.size());
+    answers.assign(shards.size(), std::string());
+
+    // sending and receiving are interleaved: a shard stops reading queries
+    // while its answers are not read
+    std::vector<pollfd> polled;
+    std::vector<size_t> polled_shards;
+    char buffer[READ_SIZE];
+    while (true) {
+        polled.clear();
+        polled_shards.clear();
+        for (size_t i = 0; i < shards.size(); ++i) {
+            short events = 0;
+            if (progress[i].written < requests.size()) {
+                events |= POLLOUT;
+            }
+            if (progress[i].answered < queries_num) {
+                events |= POLLIN;
+            }
+            if (events != 0) {
+                polled.push_back({shards[i].fd, events, 0});
+                polled_shards.push_back(i);
+            }
+        }
+        if (polled.empty()) {
+            return;
+        }
+        if (poll(polled.data(), polled.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw SystemError("poll failed");
+        }
+
+        for (size_t j = 0; j < polled.size(); ++j) {
+            const size_t i = polled_shards[j];
+            Progress& shard_progress = progress[i];
+            if (polled[j].revents & POLLOUT) {
+                const ssize_t count = send(shards[i].fd, requests.data() + shard_progress.written,
+                                           requests.size() - shard_progress.written, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (count < 0 && errno != EAGAIN && errno != EINTR) {
+                    throw SystemError("cannot send queries to shard " + std::to_string(i));
+                }
+                shard_progress.written += std::max<ssize_t>(count, 0);
+            }
+            if (polled[j].revents & (POLLIN | POLLHUP | POLLERR)) {
+                const ssize_t count = recv(shards[i].fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+                    throw std::runtime_error("ShardCoordinator: shard " + std::to_string(i) + " has exited");
+                }
+                if (count > 0) {
+                    answers[i].append(buffer, count);
+                    SkipAnswers(answers[i], shard_progress.parsed, shard_progress.answered);
+                }
+            }
+        }
+    }
+}
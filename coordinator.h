@@ -0,0 +1,69 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+struct ShardCoordinatorOptions {
+    // child processes, each indexing one contiguous docid range of the base
+    size_t shards = 2;
+    // options of the SearchServer in every shard; their answers always travel
+    // in ResultFormat::BINARY, result_format is that of the merged answers
+    SearchServerOptions server;
+};
+
+// Serves one document base from several local shard processes.
+//
+// The constructor splits the lines of a documents file into docid ranges and
+// forks one child per range. A child reads only its own lines into a
+// SearchServer and answers query lines arriving over a socketpair in the
+// binary result format. AddQueriesStream sends every query to all shards and
+// merges their tops into the answer one SearchServer over the whole file
+// would give: same documents, same IsBetterHit order.
+//
+// Children start as copies of the calling process, so create the coordinator
+// before starting other threads.
+class ShardCoordinator {
+public:
+    // Throws std::runtime_error if the file cannot be read or a shard cannot be started.
+    explicit ShardCoordinator(const std::string& documents_path, const ShardCoordinatorOptions& options = {});
+
+    ShardCoordinator(const ShardCoordinator&) = delete;
+    ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+
+    // closes the connections, which ends the shards, and waits for them to exit
+    ~ShardCoordinator();
+
+    // Answers every line of `query_input` in order, like SearchServer::AddQueriesStream,
+    // but synchronously. Throws std::runtime_error if a shard has gone away.
+    void AddQueriesStream(std::istream& query_input, std::ostream& search_results_output);
+
+    size_t GetDocsSize() const {
+        return docs_num;
+    }
+
+private:
+    struct Shard {
+        pid_t pid;
+        int fd;              // coordinator's end of the socketpair
+        size_t first_docid;  // shard docid 0 is this docid of the base
+    };
+
+    // sends `requests` (query lines) to every shard and collects the answers
+    // to `queries_num` queries from each of them
+    void Exchange(std::string_view requests, size_t queries_num, std::vector<std::string>& answers);
+
+    void Shutdown();
+
+    const ResultFormat result_format;
+    // as many documents as every shard answers with
+    const size_t max_results;
+    size_t docs_num = 0;
+    std::vector<Shard> shards;
+};
@@ -0,0 +1,340 @@
+#include "daemon.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// epoll tags of the two descriptors that are not clients
+const uint64_t LISTEN_TAG = UINT64_MAX;
+const uint64_t WAKE_TAG = UINT64_MAX - 1;
+
+// a client stops being read while this many of its requests are unanswered
+// or this many bytes of answers wait to be written
+const uint64_t MAX_PENDING_REQUESTS = 64;
+const size_t MAX_PENDING_OUTPUT = 1 << 20;
+// longest request line; a client sending more without '\n' is disconnected
+const size_t MAX_LINE_SIZE = 1 << 20;
+
+const size_t READ_SIZE = 1 << 16;
+
+std::runtime_error SystemError(const std::string& what) {
+    return std::runtime_error("SearchDaemon: " + what + ": " + std::strerror(errno));
+}
+
+}  // namespace
+
+SearchDaemon::SearchDaemon(SearchServer& server, const std::string& socket_path) :
+        server(server),
+        socket_path(socket_path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("SearchDaemon: bad socket path " + socket_path);
+    }
+    socket_path.copy(address.sun_path, socket_path.size());
+
+    try {
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            throw SystemError("cannot create socket");
+        }
+        unlink(socket_path.c_str());
+        if (bind(listen_fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            throw SystemError("cannot bind " + socket_path);
+        }
+        if (listen(listen_fd, SOMAXCONN) != 0) {
+            throw SystemError("cannot listen on " + socket_path);
+        }
+
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epoll_fd < 0 || wake_fd < 0) {
+            throw SystemError("cannot create event descriptors");
+        }
+        for (auto [fd, tag] : {std::pair{listen_fd, LISTEN_TAG}, std::pair{wake_fd, WAKE_TAG}}) {
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = tag;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+                throw SystemError("cannot watch descriptors");
+            }
+        }
+    } catch (...) {
+        CloseDescriptors();
+        throw;
+    }
+}
+
+SearchDaemon::~SearchDaemon() {
+    // workers may still be about to call Complete(); their errors have been
+    // answered to the clients already and must not escape a destructor
+    try {
+        server.Synchronize();
+    } catch (...) {
+    }
+    for (auto& [client_id, client] : clients) {
+        close(client.fd);
+    }
+    CloseDescriptors();
+}
+
+void SearchDaemon::CloseDescriptors() {
+    for (int fd : {listen_fd, epoll_fd, wake_fd}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    if (listen_fd >= 0) {
+        unlink(socket_path.c_str());
+    }
+}
+
+void SearchDaemon::Run() {
+    const int MAX_EVENTS = 64;
+    epoll_event events[MAX_EVENTS];
+    while (!stopping.load()) {
+        const int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw SystemError("epoll_wait failed");
+        }
+
+        for (int i = 0; i < ready; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == LISTEN_TAG) {
+                Accept();
+                continue;
+            }
+            if (tag == WAKE_TAG) {
+                uint64_t count;
+                while (read(wake_fd, &count, sizeof(count)) > 0) {
+                }
+                DeliverAnswers();
+                continue;
+            }
+
+            const auto it = clients.find(tag);
+            if (it == clients.end()) {
+                continue;  // closed by an earlier event of this round
+            }
+            Client& client = it->second;
+            // a peer that hung up cannot read answers any more
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                Close(tag);
+                continue;
+            }
+            if (events[i].events & EPOLLIN) {
+                Read(tag, client);
+                if (!clients.count(tag)) {
+                    continue;
+                }
+            }
+            if ((events[i].events & EPOLLOUT) && !Write(client)) {
+                Close(tag);
+                continue;
+            }
+            Refresh(tag, client);
+        }
+    }
+}
+
+void SearchDaemon::Stop() {
+    stopping.store(true);
+    const uint64_t one = 1;
+    // write() is async-signal-safe; a full counter already wakes the loop
+    [[maybe_unused]] const auto written = write(wake_fd, &one, sizeof(one));
+}
+
+void SearchDaemon::Accept() {
+    while (true) {
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            // EAGAIN: no more pending connections; anything else drops just that one
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+
+        const uint64_t client_id = next_client_id++;
+        Client& client = clients[client_id];
+        client.fd = fd;
+        epoll_event event = {};
+        event.events = client.events = EPOLLIN;
+        event.data.u64 = client_id;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            clients.erase(client_id);
+        }
+    }
+}
+
+void SearchDaemon::Read(uint64_t client_id, Client& client) {
+    // one read per wakeup keeps the loop fair between clients
+    const size_t size = client.input.size();
+    client.input.resize(size + READ_SIZE);
+    const ssize_t count = read(client.fd, client.input.data() + size, READ_SIZE);
+    client.input.resize(size + std::max<ssize_t>(count, 0));
+    if (count < 0) {
+        if (errno != EAGAIN && errno != EINTR) {
+            Close(client_id);
+        }
+        return;
+    }
+    if (count == 0) {
+        client.input_closed = true;
+        // like getline, a last line without '\n' is still a request
+        if (!client.input.empty()) {
+            client.input.push_back('\n');
+        }
+    }
+
+    HandleLines(client_id, client);
+    if (client.input.size() > MAX_LINE_SIZE) {
+        Close(client_id);
+    }
+}
+
+void SearchDaemon::HandleLines(uint64_t client_id, Client& client) {
+    // consecutive queries go to the server as one request
+    std::vector<std::string> queries;
+    auto submit_queries = [&] {
+        if (queries.empty()) {
+            return;
+        }
+        const uint64_t request = client.next_request++;
+        server.AnswerQueries(std::move(queries), [this, client_id, request](std::string answers) {
+            Complete(client_id, request, std::move(answers));
+        });
+        queries.clear();
+    };
+
+    const std::string_view input = client.input;
+    size_t start = 0;
+    for (size_t end; (end = input.find('\n', start)) != std::string_view::npos; start = end + 1) {
+        const std::string_view line = input.substr(start, end - start);
+        if (!line.empty() && line.front() == '!') {
+            submit_queries();
+            HandleCommand(client_id, client, line.substr(1));
+        } else {
+            queries.emplace_back(line);
+        }
+    }
+    submit_queries();
+    client.input.erase(0, start);
+}
+
+void SearchDaemon::HandleCommand(uint64_t client_id, Client& client, std::string_view command) {
+    const uint64_t request = client.next_request++;
+    const std::string_view RELOAD = "reload ";
+    if (command.substr(0, RELOAD.size()) == RELOAD) {
+        server.UpdateDocumentBase(std::string(command.substr(RELOAD.size())),
+                                  [this, client_id, request](std::string error) {
+            Complete(client_id, request, error.empty() ? "ok\n" : "error: " + error + "\n");
+        });
+    } else if (command == "metrics") {
+        Complete(client_id, request, server.GetMetrics().ToJson() + "\n");
+    } else if (command == "memory") {
+        Complete(client_id, request, server.GetMemoryUsage().ToJson() + "\n");
+    } else {
+        Complete(client_id, request, "error: unknown command " + std::string(command) + "\n");
+    }
+}
+
+void SearchDaemon::Complete(uint64_t client_id, uint64_t request, std::string text) {
+    {
+        std::lock_guard<std::mutex> guard(answers_mutex);
+        answers.push_back({client_id, request, std::move(text)});
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] const auto written = write(wake_fd, &one, sizeof(one));
+}
+
+void SearchDaemon::DeliverAnswers() {
+    std::vector<Answer> delivered;
+    {
+        std::lock_guard<std::mutex> guard(answers_mutex);
+        delivered.swap(answers);
+    }
+
+    for (auto& [client_id, request, text] : delivered) {
+        const auto it = clients.find(client_id);
+        if (it == clients.end()) {
+            continue;  // the client went away meanwhile
+        }
+        Client& client = it->second;
+        client.early_answers.emplace(request, std::move(text));
+        for (auto first = client.early_answers.begin();
+             first != client.early_answers.end() && first->first == client.next_answer;
+             first = client.early_answers.erase(first)) {
+            client.output += first->second;
+            ++client.next_answer;
+        }
+        if (!Write(client)) {
+            Close(client_id);
+            continue;
+        }
+        Refresh(client_id, client);
+    }
+}
+
+bool SearchDaemon::Write(Client& client) {
+    size_t written = 0;
+    while (written < client.output.size()) {
+        const ssize_t count = send(client.fd, client.output.data() + written, client.output.size() - written,
+                                   MSG_NOSIGNAL);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                return false;
+            }
+            break;
+        }
+        written += count;
+    }
+    client.output.erase(0, written);
+    return true;
+}
+
+void SearchDaemon::Refresh(uint64_t client_id, Client& client) {
+    const bool answered = client.next_answer == client.next_request && client.output.empty();
+    if (client.input_closed && answered) {
+        Close(client_id);
+        return;
+    }
+
+    uint32_t events = 0;
+    if (!client.input_closed && client.next_request - client.next_answer < MAX_PENDING_REQUESTS
+        && client.output.size() < MAX_PENDING_OUTPUT) {
+        events |= EPOLLIN;
+    }
+    if (!client.output.empty()) {
+        events |= EPOLLOUT;
+    }
+    if (events != client.events) {
+        epoll_event event = {};
+        event.events = client.events = events;
+        event.data.u64 = client_id;
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client.fd, &event);
+    }
+}
+
+void SearchDaemon::Close(uint64_t client_id) {
+    const auto it = clients.find(client_id);
+    // closing the descriptor also removes it from the epoll set
+    close(it->second.fd);
+    clients.erase(it);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "search_server.h"
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Serves a SearchServer to local clients over a Unix domain socket.
+//
+// Requests are lines. A query gets its answer line in the TEXT format; a line
+// starting with '!' is a command:
+//   !reload <path>  replaces the base with the lines of a text file; answers
+//                   "ok" once the new base is live, or "error: <reason>"
+//   !metrics        answers one line of JSON, see Metrics::Snapshot::ToJson()
+//   !memory         answers one line of JSON, see ServerMemoryUsage::ToJson()
+// Clients may send any number of requests without waiting for answers, which
+// come back in request order. Queries sent after a !reload may still be
+// answered from the old base until its "ok".
+//
+// One thread runs an epoll loop over all connections. Queries are answered on
+// the server's workers, which hand the answers back to the loop through an
+// eventfd, so no thread is created per client or request.
+class SearchDaemon {
+public:
+    // Listens on `socket_path`, replacing a stale socket file there.
+    // Throws std::runtime_error if the socket cannot be set up.
+    SearchDaemon(SearchServer& server, const std::string& socket_path);
+
+    SearchDaemon(const SearchDaemon&) = delete;
+    SearchDaemon& operator=(const SearchDaemon&) = delete;
+
+    // waits for requests still being answered, closes every connection and removes the socket file
+    ~SearchDaemon();
+
+    // serves clients until Stop() is called
+    void Run();
+
+    // makes Run() return; safe to call from any thread and from a signal handler
+    void Stop();
+
+private:
+    struct Client {
+        int fd = -1;
+        uint32_t events = 0;                            // registered with epoll
+        std::string input;                              // bytes after the last complete line
+        std::string output;                             // answers not written yet
+        uint64_t next_request = 0;                      // sequence number of the next request read
+        uint64_t next_answer = 0;                       // sequence number of the next answer to write
+        std::map<uint64_t, std::string> early_answers;  // finished before an earlier request
+        bool input_closed = false;
+    };
+
+    // answer to request `request` of client `client_id`, passed from a worker to the loop
+    struct Answer {
+        uint64_t client_id;
+        uint64_t request;
+        std::string text;
+    };
+
+    void Accept();
+
+    void Read(uint64_t client_id, Client& client);
+
+    // starts answering the complete lines of `client.input`
+    void HandleLines(uint64_t client_id, Client& client);
+
+    void HandleCommand(uint64_t client_id, Client& client, std::string_view command);
+
+    // called on any thread once the answer to a request is ready
+    void Complete(uint64_t client_id, uint64_t request, std::string text);
+
+    // moves answers from the workers to their clients
+    void DeliverAnswers();
+
+    // writes as much of the output as the socket takes; false if the peer is gone
+    bool Write(Client& client);
+
+    // closes the connection when everything is done, otherwise updates its epoll events
+    void Refresh(uint64_t client_id, Client& client);
+
+    void Close(uint64_t client_id);
+
+    void CloseDescriptors();
+
+    SearchServer& server;
+    const std::string socket_path;
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;  // eventfd: answers are waiting or Stop() was called
+    std::atomic<bool> stopping = false;
+
+    // only touched by the loop thread
+    std::unordered_map<uint64_t, Client> clients;
+    uint64_t next_client_id = 0;
+
+    std::mutex answers_mutex;
+    std::vector<Answer> answers;
+};
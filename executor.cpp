@@ -0,0 +1,169 @@
+#include "executor.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+// Executor and index of the worker running on this thread, if any
+thread_local const void* current_executor = nullptr;
+thread_local size_t current_worker = 0;
+
+}  // namespace
+
+Executor::Executor(size_t threads_num) {
+    threads_num = std::max<size_t>(threads_num, 1);
+    for (size_t i = 0; i < threads_num; ++i) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    for (size_t i = 0; i < threads_num; ++i) {
+        threads.emplace_back([this, i] { Run(i); });
+    }
+}
+
+Executor::~Executor() {
+    {
+        std::lock_guard<std::mutex> guard(m);
+        stopping = true;
+    }
+    has_tasks.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+void Executor::Submit(std::function<void()> task) {
+    size_t worker_index;
+    {
+        std::lock_guard<std::mutex> guard(m);
+        worker_index = current_executor == this ? current_worker : next_worker++ % workers.size();
+        ++unfinished;
+    }
+    {
+        std::lock_guard<std::mutex> guard(workers[worker_index]->m);
+        workers[worker_index]->tasks.push_back(std::move(task));
+    }
+    {
+        // counted only now, so a worker seeing queued > 0 is sure to find a task
+        std::lock_guard<std::mutex> guard(m);
+        ++queued;
+    }
+    has_tasks.notify_one();
+}
+
+void Executor::WaitIdle() {
+    std::unique_lock<std::mutex> lock(m);
+    is_idle.wait(lock, [this] { return unfinished == 0; });
+    if (error) {
+        std::rethrow_exception(std::exchange(error, nullptr));
+    }
+}
+
+void Executor::ParallelFor(size_t n, const std::function<void(size_t)>& func) {
+    struct Loop {
+        const std::function<void(size_t)>* func;
+        size_t n;
+        std::atomic<size_t> next = 0;
+        std::mutex m;
+        std::condition_variable all_done;
+        size_t done = 0;
+        std::exception_ptr error;
+    };
+    auto loop = std::make_shared<Loop>();
+    loop->func = &func;
+    loop->n = n;
+
+    // helpers that start late find nothing left and never touch `func`
+    auto work = [loop] {
+        size_t finished = 0;
+        for (size_t i; (i = loop->next.fetch_add(1)) < loop->n; ++finished) {
+            try {
+                (*loop->func)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(loop->m);
+                if (!loop->error) {
+                    loop->error = std::current_exception();
+                }
+            }
+        }
+        if (finished > 0) {
+            std::lock_guard<std::mutex> guard(loop->m);
+            loop->done += finished;
+            if (loop->done == loop->n) {
+                loop->all_done.notify_all();
+            }
+        }
+    };
+    for (size_t helpers = std::min(n, workers.size()); helpers > 1; --helpers) {
+        Submit(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(loop->m);
+    loop->all_done.wait(lock, [&loop] { return loop->done == loop->n; });
+    if (loop->error) {
+        std::rethrow_exception(loop->error);
+    }
+}
+
+bool Executor::TryTake(size_t worker_index, std::function<void()>& task) {
+    {
+        Worker& own = *workers[worker_index];
+        std::lock_guard<std::mutex> guard(own.m);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t shift = 1; shift < workers.size(); ++shift) {
+        Worker& victim = *workers[(worker_index + shift) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.m);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Executor::Run(size_t worker_index) {
+    current_executor = this;
+    current_worker = worker_index;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            has_tasks.wait(lock, [this] { return queued > 0 || stopping; });
+            if (queued == 0) {
+                return;
+            }
+        }
+
+        std::function<void()> task;
+        if (!TryTake(worker_index, task)) {
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> guard(m);
+            --queued;
+        }
+
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(m);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        // captured state goes away before anyone waiting for idle is released
+        task = nullptr;
+
+        std::lock_guard<std::mutex> guard(m);
+        if (--unfinished == 0) {
+            is_idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed pool of worker threads with a task deque per worker.
+// A task submitted from a worker goes to that worker's deque, any other task
+// is dealt round-robin. Workers take their own tasks oldest first and, when
+// out of work, steal the newest task of another worker.
+class Executor {
+public:
+    explicit Executor(size_t threads_num);
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // runs the tasks still queued, then joins the workers
+    ~Executor();
+
+    void Submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished, including the ones they
+    // submitted. Rethrows the first exception thrown by a task since the last call.
+    void WaitIdle();
+
+    // Calls func(0), ..., func(n - 1) on idle workers and the calling thread and
+    // returns when all calls are done. The caller makes every call nobody else
+    // has started, so it never waits for a queued task and may itself be a task.
+    // Rethrows the first exception thrown by func.
+    void ParallelFor(size_t n, const std::function<void(size_t)>& func);
+
+    size_t Size() const {
+        return workers.size();
+    }
+
+private:
+    struct Worker {
+        std::mutex m;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool TryTake(size_t worker_index, std::function<void()>& task);
+
+    void Run(size_t worker_index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex m;
+    std::condition_variable has_tasks;
+    std::condition_variable is_idle;
+    size_t queued = 0;      // submitted, not taken by a worker yet
+    size_t unfinished = 0;  // submitted, not finished yet
+    size_t next_worker = 0;
+    bool stopping = false;
+    std::exception_ptr error;
+};
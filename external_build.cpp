@@ -0,0 +1,411 @@
+#include "index_file.h"
+#include "inverted_index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+
+#include <stdlib.h>
+
+namespace {
+
+// A run holds the postings of a batch of documents term by term, terms in
+// lexicographic order, in two files:
+//     <run>.terms     uint32_t term length, term bytes, uint64_t postings count
+//     <run>.postings  Item[count] of every term one after another
+// so that merging just the terms reads no postings. Batches are consecutive
+// docid ranges: concatenating the postings of a term over runs in batch order
+// keeps them sorted.
+
+// at most this many runs are open in one merge; more are merged in groups first
+const size_t MAX_MERGE_WIDTH = 64;
+
+// postings copied between files at a time
+const size_t COPY_ITEMS = 1 << 12;
+
+// removes everything in it on destruction
+class TemporaryDirectory {
+public:
+    explicit TemporaryDirectory(const std::string& parent) {
+        std::string pattern = (parent.empty() ? std::filesystem::temp_directory_path().string() : parent)
+                              + "/search_engine_build.XXXXXX";
+        if (!mkdtemp(pattern.data())) {
+            throw std::runtime_error("InvertedIndex::BuildFile: cannot create a directory like " + pattern
+                                     + ": " + std::strerror(errno));
+        }
+        path = std::move(pattern);
+    }
+
+    ~TemporaryDirectory() {
+        std::error_code ignored;
+        std::filesystem::remove_all(path, ignored);
+    }
+
+    std::string File(const std::string& name) const {
+        return path + "/" + name;
+    }
+
+private:
+    std::string path;
+};
+
+std::ofstream CreateFile(const std::string& path) {
+    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+    if (!output) {
+        throw std::runtime_error("InvertedIndex::BuildFile: cannot create " + path);
+    }
+    return output;
+}
+
+void CloseFile(std::ofstream& output, const std::string& path) {
+    output.close();
+    if (!output) {
+        throw std::runtime_error("InvertedIndex::BuildFile: cannot write " + path);
+    }
+}
+
+template<typename T>
+void WriteValue(std::ostream& output, const T& value) {
+    output.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+class RunWriter {
+public:
+    explicit RunWriter(const std::string& path) :
+            path(path),
+            terms(CreateFile(path + ".terms")),
+            postings(CreateFile(path + ".postings"))
+    {
+    }
+
+    // starts a term; exactly `size` postings must follow
+    void BeginTerm(std::string_view term, uint64_t size) {
+        WriteValue(terms, static_cast<uint32_t>(term.size()));
+        terms.write(term.data(), static_cast<std::streamsize>(term.size()));
+        WriteValue(terms, size);
+    }
+
+    void Write(const Item* items, size_t size) {
+        postings.write(reinterpret_cast<const char*>(items), static_cast<std::streamsize>(size * sizeof(Item)));
+    }
+
+    void Finish() {
+        CloseFile(terms, path + ".terms");
+        CloseFile(postings, path + ".postings");
+    }
+
+private:
+    std::string path;
+    std::ofstream terms;
+    std::ofstream postings;
+};
+
+// reads a run term by term; the postings of a term may be read or skipped
+class RunReader {
+public:
+    explicit RunReader(const std::string& path) :
+            path(path),
+            terms(path + ".terms", std::ios::binary),
+            postings(path + ".postings", std::ios::binary)
+    {
+        if (!terms || !postings) {
+            throw std::runtime_error("InvertedIndex::BuildFile: cannot open run " + path);
+        }
+        Next();
+    }
+
+    bool Done() const {
+        return done;
+    }
+
+    const std::string& Term() const {
+        return term;
+    }
+
+    uint64_t Size() const {
+        return size;
+    }
+
+    // reads up to `max_size` unread postings of the current term
+    size_t Read(Item* items, size_t max_size) {
+        if (skipped != 0) {
+            postings.seekg(static_cast<std::streamoff>(skipped * sizeof(Item)), std::ios::cur);
+            skipped = 0;
+        }
+        const size_t count = std::min<uint64_t>(max_size, unread);
+        postings.read(reinterpret_cast<char*>(items), static_cast<std::streamsize>(count * sizeof(Item)));
+        Check(postings);
+        unread -= count;
+        return count;
+    }
+
+    // moves to the next term, skipping unread postings of this one
+    void Next() {
+        // seeking drops the stream buffer, so skips add up until the next Read()
+        skipped += unread;
+        unread = 0;
+        uint32_t length;
+        if (!terms.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+            done = true;
+            return;
+        }
+        term.resize(length);
+        terms.read(term.data(), length);
+        terms.read(reinterpret_cast<char*>(&size), sizeof(size));
+        Check(terms);
+        unread = size;
+    }
+
+private:
+    void Check(const std::ifstream& input) const {
+        if (!input) {
+            throw std::runtime_error("InvertedIndex::BuildFile: truncated run " + path);
+        }
+    }
+
+    std::string path;
+    std::ifstream terms;
+    std::ifstream postings;
+    std::string term;
+    uint64_t size = 0;
+    uint64_t unread = 0;
+    uint64_t skipped = 0;
+    bool done = false;
+};
+
+// Calls on_term(term, readers) for every term of the runs in lexicographic
+// order; `readers` are the runs containing the term, in run order.
+template<typename Callback>
+void MergeRuns(const std::vector<std::string>& runs, Callback on_term) {
+    std::vector<RunReader> readers;
+    readers.reserve(runs.size());
+    for (const auto& run : runs) {
+        readers.emplace_back(run);
+    }
+
+    auto later = [&readers](size_t lhs, size_t rhs) {
+        return std::tie(readers[lhs].Term(), lhs) > std::tie(readers[rhs].Term(), rhs);
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+    for (size_t run = 0; run < readers.size(); ++run) {
+        if (!readers[run].Done()) {
+            heap.push(run);
+        }
+    }
+
+    std::vector<size_t> group;
+    std::vector<RunReader*> group_readers;
+    while (!heap.empty()) {
+        const std::string term = readers[heap.top()].Term();
+        group.clear();
+        group_readers.clear();
+        while (!heap.empty() && readers[heap.top()].Term() == term) {
+            group.push_back(heap.top());
+            group_readers.push_back(&readers[heap.top()]);
+            heap.pop();
+        }
+        on_term(term, group_readers);
+        for (size_t run : group) {
+            readers[run].Next();
+            if (!readers[run].Done()) {
+                heap.push(run);
+            }
+        }
+    }
+}
+
+// writes a batch index as a run
+void WriteRun(const TermDictionary& terms, const std::vector<std::pmr::vector<Item>>& postings,
+              const std::string& path) {
+    std::vector<uint32_t> order(terms.Size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&terms](uint32_t lhs, uint32_t rhs) {
+        return terms.Term(lhs) < terms.Term(rhs);
+    });
+
+    RunWriter writer(path);
+    for (uint32_t term_id : order) {
+        writer.BeginTerm(terms.Term(term_id), postings[term_id].size());
+        writer.Write(postings[term_id].data(), postings[term_id].size());
+    }
+    writer.Finish();
+}
+
+// merges groups of consecutive runs until at most MAX_MERGE_WIDTH are left
+void ReduceRuns(std::vector<std::string>& runs, const TemporaryDirectory& directory) {
+    std::vector<Item> items(COPY_ITEMS);
+    for (size_t pass = 0; runs.size() > MAX_MERGE_WIDTH; ++pass) {
+        std::vector<std::string> merged;
+        for (size_t first = 0; first < runs.size(); first += MAX_MERGE_WIDTH) {
+            const size_t last = std::min(first + MAX_MERGE_WIDTH, runs.size());
+            const std::vector<std::string> group(runs.begin() + first, runs.begin() + last);
+            merged.push_back(directory.File("merge" + std::to_string(pass) + "." + std::to_string(merged.size())));
+
+            RunWriter writer(merged.back());
+            MergeRuns(group, [&](const std::string& term, const std::vector<RunReader*>& readers) {
+                uint64_t size = 0;
+                for (const RunReader* reader : readers) {
+                    size += reader->Size();
+                }
+                writer.BeginTerm(term, size);
+                for (RunReader* reader : readers) {
+                    while (const size_t count = reader->Read(items.data(), items.size())) {
+                        writer.Write(items.data(), count);
+                    }
+                }
+            });
+            writer.Finish();
+            for (const auto& run : group) {
+                std::filesystem::remove(run + ".terms");
+                std::filesystem::remove(run + ".postings");
+            }
+        }
+        runs = std::move(merged);
+    }
+}
+
+void CopyFile(const std::string& path, IndexFileWriter& writer) {
+    std::ifstream input(path, std::ios::binary);
+    std::vector<char> buffer(COPY_ITEMS * sizeof(Item));
+    while (input.read(buffer.data(), static_cast<std::streamsize>(buffer.size())) || input.gcount() > 0) {
+        writer.Write(buffer.data(), input.gcount());
+    }
+    if (!input.eof()) {
+        throw std::runtime_error("InvertedIndex::BuildFile: cannot read " + path);
+    }
+}
+
+}  // namespace
+
+void InvertedIndex::BuildFile(std::istream& document_input, const std::string& path,
+                              const ExternalBuildOptions& options) {
+    const TemporaryDirectory directory(options.temp_directory);
+
+    // document text and offsets go to disk right away, postings once a batch is full
+    const std::string text_path = directory.File("text");
+    const std::string offsets_path = directory.File("offsets");
+    std::ofstream text_output = CreateFile(text_path);
+    std::ofstream offsets_output = CreateFile(offsets_path);
+    std::vector<std::string> runs;
+    std::optional<Index> batch(std::in_place);
+    auto spill = [&] {
+        runs.push_back(directory.File("run" + std::to_string(runs.size())));
+        WriteRun(batch->terms, batch->postings, runs.back());
+        // a new batch, its vectors released before their pools
+        batch.emplace();
+    };
+
+    size_t docs = 0;
+    uint64_t text_size = 0;
+    WriteValue(offsets_output, text_size);
+    for (std::string document; std::getline(document_input, document); ++docs) {
+        text_output.write(document.data(), static_cast<std::streamsize>(document.size()));
+        text_size += document.size();
+        WriteValue(offsets_output, text_size);
+
+        batch->AddDocument(docs, document);
+        if (batch->MemoryBytes() >= options.memory_limit) {
+            spill();
+        }
+    }
+    if (batch->terms.Size() != 0) {
+        spill();
+    }
+    batch.reset();
+    CloseFile(text_output, text_path);
+    CloseFile(offsets_output, offsets_path);
+    ReduceRuns(runs, directory);
+
+    const bool compressed = options.compress_postings;
+    IndexFileWriter writer(path, compressed ? INDEX_FILE_FLAG_COMPRESSED : 0);
+
+    // the dictionary sections come first, so the runs are merged twice:
+    // once for the terms and once for their postings
+    TermDictionary terms;
+    MergeRuns(runs, [&terms](const std::string& term, const std::vector<RunReader*>&) {
+        terms.Insert(term);
+    });
+    const TermDictionary::Layout dictionary = terms.GetLayout();
+    writer.BeginSection(SLOTS);
+    writer.Write(dictionary.slots, dictionary.slot_count * sizeof(TermDictionary::Slot));
+    writer.BeginSection(POOL);
+    writer.Write(dictionary.pool, dictionary.pool_size);
+    writer.BeginSection(TERM_OFFSETS);
+    writer.Write(dictionary.offsets, (dictionary.terms + 1) * sizeof(uint32_t));
+
+    // postings pass through in blocks, so a list of any length takes no memory
+    std::vector<ListRange> lists;
+    lists.reserve(dictionary.terms + 1);
+    std::vector<uint32_t> max_hits;
+    max_hits.reserve(dictionary.terms);
+    std::vector<uint32_t> block_max_hits;
+    std::vector<uint64_t> block_max_offsets = {0};
+    block_max_offsets.reserve(dictionary.terms + 1);
+    size_t data_size = 0;
+
+    Item block[POSTING_BLOCK_SIZE];
+    std::vector<uint8_t> encoded;
+    writer.BeginSection(POSTING_DATA);
+    MergeRuns(runs, [&](const std::string&, const std::vector<RunReader*>& readers) {
+        uint64_t size = 0;
+        for (const RunReader* reader : readers) {
+            size += reader->Size();
+        }
+        lists.push_back({compressed ? data_size : data_size / sizeof(Item), size});
+        max_hits.push_back(0);
+
+        size_t block_size = 0;
+        uint32_t base = 0;
+        auto flush = [&] {
+            if (compressed) {
+                encoded.clear();
+                AppendCompressedPostings(block, block_size, encoded, base);
+                writer.Write(encoded.data(), encoded.size());
+                data_size += encoded.size();
+                base = static_cast<uint32_t>(block[block_size - 1].docid);
+            } else {
+                writer.Write(block, block_size * sizeof(Item));
+                data_size += block_size * sizeof(Item);
+            }
+            AppendBlockMaxHits(block, block_size, block_max_hits);
+            max_hits.back() = std::max(max_hits.back(), block_max_hits.back());
+            block_size = 0;
+        };
+        for (RunReader* reader : readers) {
+            while (const size_t count = reader->Read(block + block_size, POSTING_BLOCK_SIZE - block_size)) {
+                block_size += count;
+                if (block_size == POSTING_BLOCK_SIZE) {
+                    flush();
+                }
+            }
+        }
+        if (block_size != 0) {
+            flush();
+        }
+        block_max_offsets.push_back(block_max_hits.size());
+    });
+    lists.push_back({compressed ? data_size : data_size / sizeof(Item), 0});
+    writer.BeginSection(POSTING_LISTS);
+    writer.Write(lists.data(), lists.size() * sizeof(ListRange));
+
+    writer.BeginSection(DOC_TEXT);
+    CopyFile(text_path, writer);
+    writer.BeginSection(DOC_OFFSETS);
+    CopyFile(offsets_path, writer);
+
+    writer.BeginSection(TERM_MAX_HITS);
+    writer.Write(max_hits.data(), max_hits.size() * sizeof(uint32_t));
+    writer.BeginSection(BLOCK_MAX_HITS);
+    writer.Write(block_max_hits.data(), block_max_hits.size() * sizeof(uint32_t));
+    writer.BeginSection(BLOCK_MAX_OFFSETS);
+    writer.Write(block_max_offsets.data(), block_max_offsets.size() * sizeof(uint64_t));
+    writer.BeginSection(ORIGINAL_DOCIDS);
+
+    writer.Finish(dictionary.terms, dictionary.slot_count, docs);
+}
@@ -0,0 +1,238 @@
+#include "index_file.h"
+#include "inverted_index.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<IndexFileHeader> && sizeof(IndexFileHeader) % 8 == 0);
+static_assert(std::is_trivially_copyable_v<TermDictionary::Slot>);
+static_assert(std::is_trivially_copyable_v<Item>);
+
+void IndexFileChecksum::Mix(uint64_t word) {
+    state = (state ^ word) * 0x9e3779b97f4a7c15ull;
+    state ^= state >> 29;
+}
+
+void IndexFileChecksum::Update(const void* data, size_t size) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    total_bytes += size;
+
+    while (pending_bytes != 0 && size != 0) {
+        pending |= uint64_t(*bytes++) << (8 * pending_bytes);
+        --size;
+        if (++pending_bytes == 8) {
+            Mix(pending);
+            pending = 0;
+            pending_bytes = 0;
+        }
+    }
+    for (; size >= 8; bytes += 8, size -= 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes, 8);
+        Mix(word);
+    }
+    for (; size != 0; --size) {
+        pending |= uint64_t(*bytes++) << (8 * pending_bytes++);
+    }
+}
+
+uint64_t IndexFileChecksum::Finish() const {
+    IndexFileChecksum copy = *this;
+    copy.Mix(copy.pending);
+    copy.Mix(total_bytes);
+    return copy.state;
+}
+
+IndexFileWriter::IndexFileWriter(const std::string& path, uint32_t flags) :
+        path(path),
+        output(path, std::ios::binary | std::ios::trunc)
+{
+    if (!output) {
+        throw std::runtime_error("IndexFileWriter: cannot create " + path);
+    }
+    std::memcpy(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic));
+    header.version = INDEX_FILE_VERSION;
+    header.flags = flags;
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+void IndexFileWriter::BeginSection(IndexFileSection section) {
+    if (static_cast<int>(section) <= current_section) {
+        throw std::logic_error("IndexFileWriter: sections must be written in order");
+    }
+    EndSection();
+
+    static const char padding[8] = {};
+    Write(padding, (8 - position % 8) % 8);
+    current_section = section;
+    header.sections[section].offset = position;
+}
+
+void IndexFileWriter::Write(const void* data, size_t size) {
+    output.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+    checksum.Update(data, size);
+    position += size;
+}
+
+void IndexFileWriter::EndSection() {
+    if (current_section >= 0) {
+        header.sections[current_section].size = position - header.sections[current_section].offset;
+    }
+}
+
+void IndexFileWriter::Finish(uint64_t terms, uint64_t slot_count, uint64_t docs) {
+    EndSection();
+    header.terms = terms;
+    header.slot_count = slot_count;
+    header.docs = docs;
+    header.checksum = checksum.Finish();
+
+    output.seekp(0);
+    output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    output.close();
+    if (!output) {
+        throw std::runtime_error("IndexFileWriter: cannot write " + path);
+    }
+}
+
+namespace {
+
+template<typename T>
+const T* SectionData(const MappedFile& file, const IndexFileHeader& header,
+                     IndexFileSection section, uint64_t expected_count) {
+    const auto& [offset, size] = header.sections[section];
+    if (offset % alignof(T) != 0 || offset > file.Size() || size > file.Size() - offset
+        || size / sizeof(T) < expected_count) {
+        throw std::runtime_error("InvertedIndex::Map: malformed index file section");
+    }
+    return reinterpret_cast<const T*>(file.Data() + offset);
+}
+
+}  // namespace
+
+void InvertedIndex::Save(const std::string& path) const {
+    const bool compressed = IsCompressed();
+    IndexFileWriter writer(path, compressed ? INDEX_FILE_FLAG_COMPRESSED : 0);
+
+    const TermDictionary::Layout dictionary = index.terms.GetLayout();
+    writer.BeginSection(SLOTS);
+    writer.Write(dictionary.slots, dictionary.slot_count * sizeof(TermDictionary::Slot));
+    writer.BeginSection(POOL);
+    writer.Write(dictionary.pool, dictionary.pool_size);
+    writer.BeginSection(TERM_OFFSETS);
+    writer.Write(dictionary.offsets, (dictionary.terms + 1) * sizeof(uint32_t));
+
+    std::vector<ListRange> lists;
+    lists.reserve(dictionary.terms + 1);
+    size_t data_size = 0;
+    writer.BeginSection(POSTING_DATA);
+    for (uint32_t term_id = 0; term_id < dictionary.terms; ++term_id) {
+        const PostingList list = Postings(term_id);
+        lists.push_back({compressed ? data_size : data_size / sizeof(Item), list.Size()});
+        if (compressed) {
+            writer.Write(list.Blocks(), list.MemoryBytes());
+        } else {
+            writer.Write(list.Items(), list.MemoryBytes());
+        }
+        data_size += list.MemoryBytes();
+    }
+    lists.push_back({compressed ? data_size : data_size / sizeof(Item), 0});
+    writer.BeginSection(POSTING_LISTS);
+    writer.Write(lists.data(), lists.size() * sizeof(ListRange));
+
+    std::vector<uint64_t> doc_offsets = {0};
+    writer.BeginSection(DOC_TEXT);
+    for (size_t docid = 0; docid < GetDocsSize(); ++docid) {
+        const std::string_view document = GetDocument(docid);
+        writer.Write(document.data(), document.size());
+        doc_offsets.push_back(doc_offsets.back() + document.size());
+    }
+    writer.BeginSection(DOC_OFFSETS);
+    writer.Write(doc_offsets.data(), doc_offsets.size() * sizeof(uint64_t));
+
+    std::vector<uint32_t> max_hits;
+    std::vector<uint32_t> block_max_hits;
+    std::vector<uint64_t> block_max_offsets = {0};
+    max_hits.reserve(dictionary.terms);
+    for (uint32_t term_id = 0; term_id < dictionary.terms; ++term_id) {
+        const PostingList list = Postings(term_id);
+        max_hits.push_back(list.MaxHits());
+        const std::vector<Item> items = list.ToVector();
+        AppendBlockMaxHits(items.data(), items.size(), block_max_hits);
+        block_max_offsets.push_back(block_max_hits.size());
+    }
+    writer.BeginSection(TERM_MAX_HITS);
+    writer.Write(max_hits.data(), max_hits.size() * sizeof(uint32_t));
+    writer.BeginSection(BLOCK_MAX_HITS);
+    writer.Write(block_max_hits.data(), block_max_hits.size() * sizeof(uint32_t));
+    writer.BeginSection(BLOCK_MAX_OFFSETS);
+    writer.Write(block_max_offsets.data(), block_max_offsets.size() * sizeof(uint64_t));
+    writer.BeginSection(ORIGINAL_DOCIDS);
+    if (const uint32_t* original_docids = OriginalDocids()) {
+        writer.Write(original_docids, GetDocsSize() * sizeof(uint32_t));
+    }
+
+    writer.Finish(dictionary.terms, dictionary.slot_count, GetDocsSize());
+}
+
+InvertedIndex InvertedIndex::Map(const std::string& path, bool verify_checksum) {
+    auto file = std::make_shared<const MappedFile>(path);
+
+    IndexFileHeader header;
+    if (file->Size() < sizeof(header)) {
+        throw std::runtime_error("InvertedIndex::Map: " + path + " is not an index file");
+    }
+    std::memcpy(&header, file->Data(), sizeof(header));
+    if (std::memcmp(header.magic, INDEX_FILE_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("InvertedIndex::Map: " + path + " is not an index file");
+    }
+    if (header.version != INDEX_FILE_VERSION) {
+        throw std::runtime_error("InvertedIndex::Map: " + path + " has unsupported version "
+                                 + std::to_string(header.version));
+    }
+    if (verify_checksum) {
+        IndexFileChecksum checksum;
+        checksum.Update(file->Data() + sizeof(header), file->Size() - sizeof(header));
+        if (checksum.Finish() != header.checksum) {
+            throw std::runtime_error("InvertedIndex::Map: checksum mismatch in " + path);
+        }
+    }
+    if (header.slot_count == 0 || (header.slot_count & (header.slot_count - 1)) != 0
+        || header.terms >= header.slot_count) {
+        throw std::runtime_error("InvertedIndex::Map: malformed dictionary in " + path);
+    }
+
+    const auto* term_offsets = SectionData<uint32_t>(*file, header, TERM_OFFSETS, header.terms + 1);
+    const auto* pool = SectionData<char>(*file, header, POOL, term_offsets[header.terms]);
+
+    InvertedIndex result;
+    result.index.terms = TermDictionary({
+        SectionData<TermDictionary::Slot>(*file, header, SLOTS, header.slot_count), header.slot_count,
+        pool, header.sections[POOL].size,
+        term_offsets, header.terms
+    });
+
+    MappedStorage storage = {};
+    storage.compressed = (header.flags & INDEX_FILE_FLAG_COMPRESSED) != 0;
+    storage.lists = SectionData<ListRange>(*file, header, POSTING_LISTS, header.terms + 1);
+    if (storage.compressed) {
+        storage.blocks = SectionData<uint8_t>(*file, header, POSTING_DATA, storage.lists[header.terms].offset);
+    } else {
+        storage.items = SectionData<Item>(*file, header, POSTING_DATA, storage.lists[header.terms].offset);
+    }
+    storage.doc_offsets = SectionData<uint64_t>(*file, header, DOC_OFFSETS, header.docs + 1);
+    storage.text = SectionData<char>(*file, header, DOC_TEXT, storage.doc_offsets[header.docs]);
+    storage.docs = header.docs;
+    storage.max_hits = SectionData<uint32_t>(*file, header, TERM_MAX_HITS, header.terms);
+    storage.block_max_offsets = SectionData<uint64_t>(*file, header, BLOCK_MAX_OFFSETS, header.terms + 1);
+    storage.block_max_hits = SectionData<uint32_t>(*file, header, BLOCK_MAX_HITS,
+                                                   storage.block_max_offsets[header.terms]);
+    if (header.sections[ORIGINAL_DOCIDS].size != 0) {
+        storage.original_docids = SectionData<uint32_t>(*file, header, ORIGINAL_DOCIDS, header.docs);
+    }
+    storage.file = std::move(file);
+
+    result.mapped = std::move(storage);
+    return result;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+// Binary index file written by InvertedIndex::Save and used in place by
+// InvertedIndex::Map. A fixed header is followed by the sections below, each
+// starting at a multiple of 8 bytes. Everything is in host byte order.
+//
+//     SLOTS          TermDictionary::Slot[slot_count]
+//     POOL           term bytes
+//     TERM_OFFSETS   uint32_t[terms + 1], term id -> start in POOL
+//     POSTING_DATA   Item[] or compressed blocks (FLAG_COMPRESSED)
+//     POSTING_LISTS  ListRange[terms + 1], term id -> postings in POSTING_DATA
+//     DOC_TEXT       documents back to back
+//     DOC_OFFSETS    uint64_t[docs + 1], docid -> start in DOC_TEXT
+//     TERM_MAX_HITS  uint32_t[terms], largest hit count in each posting list
+//     BLOCK_MAX_HITS uint32_t[], largest hit count of every block of every list
+//     BLOCK_MAX_OFFSETS uint64_t[terms + 1], term id -> start in BLOCK_MAX_HITS
+//     ORIGINAL_DOCIDS uint32_t[docs] (InvertedIndex::OriginalDocids) or empty
+//
+// The checksum covers every byte after the header.
+enum IndexFileSection {
+    SLOTS,
+    POOL,
+    TERM_OFFSETS,
+    POSTING_DATA,
+    POSTING_LISTS,
+    DOC_TEXT,
+    DOC_OFFSETS,
+    TERM_MAX_HITS,
+    BLOCK_MAX_HITS,
+    BLOCK_MAX_OFFSETS,
+    ORIGINAL_DOCIDS,
+    SECTIONS_NUM
+};
+
+constexpr char INDEX_FILE_MAGIC[8] = "SEINDEX";
+constexpr uint32_t INDEX_FILE_VERSION = 3;
+constexpr uint32_t INDEX_FILE_FLAG_COMPRESSED = 1;
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t checksum;
+    uint64_t terms;
+    uint64_t slot_count;
+    uint64_t docs;
+    struct {
+        uint64_t offset;
+        uint64_t size;
+    } sections[SECTIONS_NUM];
+};
+
+// Word-at-a-time hash used as the file checksum; accepts data in any chunks.
+class IndexFileChecksum {
+public:
+    void Update(const void* data, size_t size);
+
+    uint64_t Finish() const;
+
+private:
+    void Mix(uint64_t word);
+
+    uint64_t state = 0x6a09e667f3bcc908ull;
+    uint64_t pending = 0;
+    size_t pending_bytes = 0;
+    uint64_t total_bytes = 0;
+};
+
+// Streams sections into a new index file in IndexFileSection order.
+class IndexFileWriter {
+public:
+    IndexFileWriter(const std::string& path, uint32_t flags);
+
+    void BeginSection(IndexFileSection section);
+
+    void Write(const void* data, size_t size);
+
+    // fills in the header; the file is complete after this call
+    void Finish(uint64_t terms, uint64_t slot_count, uint64_t docs);
+
+private:
+    void EndSection();
+
+    std::string path;
+    std::ofstream output;
+    IndexFileHeader header = {};
+    IndexFileChecksum checksum;
+    uint64_t position = sizeof(IndexFileHeader);
+    int current_section = -1;
+};
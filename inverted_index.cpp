@@ -0,0 +1,426 @@
+#include "inverted_index.h"
+#include "parse.h"
+#include "reorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <iterator>
+#include <stdexcept>
+
+namespace {
+
+// documents indexed between two checks of the memory limit
+const size_t MEMORY_CHECK_DOCS = 1024;
+
+std::runtime_error MemoryLimitError(size_t memory_limit, const char* stage) {
+    return std::runtime_error("InvertedIndex: more than the memory limit of " + std::to_string(memory_limit)
+                              + " bytes needed while " + stage);
+}
+
+}  // namespace
+
+InvertedIndex::InvertedIndex(std::istream& document_input, const IndexBuildOptions& options) {
+    ReadDocuments(document_input);
+    CheckMemoryLimit(options.memory_limit, 0, "reading documents");
+    if (options.reorder_documents) {
+        ReorderDocuments();
+    }
+    if (options.threads <= 1) {
+        for (size_t docid = 0; docid < GetDocsSize(); ++docid) {
+            index.AddDocument(docid, GetDocument(docid));
+            if (docid % MEMORY_CHECK_DOCS == 0) {
+                CheckMemoryLimit(options.memory_limit, 0, "indexing");
+            }
+        }
+    } else {
+        BuildParallel(options.threads, options.memory_limit);
+    }
+    CheckMemoryLimit(options.memory_limit, 0, "indexing");
+
+    // freezing copies every list before the vectors go; compressing starts by freezing
+    size_t postings_num = 0;
+    for (const auto& items : index.postings) {
+        postings_num += items.size();
+    }
+    CheckMemoryLimit(options.memory_limit, postings_num * sizeof(Item) + index.postings.size() * sizeof(ListRange),
+                     "freezing postings");
+    BuildBlockBounds();
+
+    if (options.compress_postings) {
+        Compress();
+    } else {
+        Freeze();
+    }
+}
+
+void InvertedIndex::ReadDocuments(std::istream& document_input) {
+    const size_t first = texts.size();
+
+    // streams that can tell their remaining size are read with a single call
+    // into exactly the memory they need, plus a '\n' the last line may lack;
+    // some (a directory opened as a file) report sizes that cannot be right
+    bool sized = false;
+    const auto begin = document_input.tellg();
+    if (begin != std::istream::pos_type(-1) && document_input.seekg(0, std::ios::end)) {
+        const auto end = document_input.tellg();
+        document_input.seekg(begin);
+        if (end >= begin && static_cast<uint64_t>(end - begin) < texts.max_size() - first - 1) {
+            texts.reserve(first + static_cast<size_t>(end - begin) + 1);
+            sized = true;
+        }
+    }
+    document_input.clear();
+
+    const size_t CHUNK_SIZE = 1 << 20;
+    for (size_t size = first; document_input.peek() != std::istream::traits_type::eof(); ) {
+        texts.resize(texts.capacity() > size + 1 ? texts.capacity() - 1 : size + CHUNK_SIZE);
+        document_input.read(texts.data() + size, texts.size() - size);
+        size += document_input.gcount();
+        texts.resize(size);
+    }
+    if (document_input.bad()) {
+        throw std::runtime_error("InvertedIndex: cannot read the documents");
+    }
+
+    // same lines as getline would give: a final '\n' does not start a document
+    for (size_t pos = first; pos < texts.size(); ) {
+        pos = FindSeparator(texts, pos, '\n');
+        if (pos == texts.size()) {
+            texts.push_back('\n');
+        }
+        doc_starts.push_back(++pos);
+    }
+    if (!sized) {
+        // chunks and their doubling leave up to half of the text unused
+        texts.shrink_to_fit();
+    }
+}
+
+void InvertedIndex::AppendDocument(std::string_view document) {
+    texts.append(document);
+    texts.push_back('\n');
+    doc_starts.push_back(texts.size());
+}
+
+void InvertedIndex::ReorderDocuments() {
+    // distinct term ids of every document
+    TermDictionary terms;
+    std::vector<uint32_t> doc_terms;
+    std::vector<size_t> starts = {0};
+    for (size_t docid = 0; docid < GetDocsSize(); ++docid) {
+        ForEachWord(GetDocument(docid), [&](std::string_view word) {
+            doc_terms.push_back(terms.Insert(word));
+        });
+        std::sort(doc_terms.begin() + starts.back(), doc_terms.end());
+        doc_terms.erase(std::unique(doc_terms.begin() + starts.back(), doc_terms.end()), doc_terms.end());
+        starts.push_back(doc_terms.size());
+    }
+    std::vector<uint32_t> order = BisectionOrder(doc_terms, starts, terms.Size());
+
+    std::string reordered_texts;
+    reordered_texts.reserve(texts.size());
+    std::vector<uint64_t> reordered_starts = {0};
+    reordered_starts.reserve(doc_starts.size());
+    for (uint32_t docid : order) {
+        reordered_texts.append(texts, doc_starts[docid], doc_starts[docid + 1] - doc_starts[docid]);
+        reordered_starts.push_back(reordered_texts.size());
+    }
+    texts = std::move(reordered_texts);
+    doc_starts = std::move(reordered_starts);
+    if (!std::is_sorted(order.begin(), order.end())) {
+        original_docids = std::move(order);
+    }
+}
+
+InvertedIndex::Index::Index() {
+    memory.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>());
+}
+
+InvertedIndex::Index::Index(const Index& other) :
+        terms(other.terms),
+        max_hits(other.max_hits)
+{
+    memory.push_back(std::make_unique<std::pmr::unsynchronized_pool_resource>());
+    postings.reserve(other.postings.size());
+    for (const auto& items : other.postings) {
+        postings.emplace_back(items.begin(), items.end(), memory.front().get());
+        posting_bytes += postings.back().capacity() * sizeof(Item);
+    }
+}
+
+InvertedIndex::Index& InvertedIndex::Index::operator=(const Index& other) {
+    if (this != &other) {
+        *this = Index(other);
+    }
+    return *this;
+}
+
+InvertedIndex::Index& InvertedIndex::Index::operator=(Index&& other) noexcept {
+    postings = std::move(other.postings);
+    memory = std::move(other.memory);
+    terms = std::move(other.terms);
+    max_hits = std::move(other.max_hits);
+    posting_bytes = other.posting_bytes;
+    return *this;
+}
+
+void InvertedIndex::Index::AddDocument(size_t docid, std::string_view document) {
+    // sorting groups the occurrences of each word into a run and keeps
+    // new terms inserted in lexicographic order
+    thread_local std::vector<std::string_view> words;
+    words.clear();
+    ForEachWord(document, [](std::string_view word) {
+        words.push_back(word);
+    });
+    std::sort(words.begin(), words.end());
+
+    for (size_t first = 0; first < words.size(); ) {
+        size_t last = first + 1;
+        while (last < words.size() && words[last] == words[first]) {
+            ++last;
+        }
+        const uint32_t term_id = terms.Insert(words[first]);
+        if (term_id == postings.size()) {
+            postings.emplace_back(memory.front().get());
+            max_hits.push_back(0);
+        }
+        auto& items = postings[term_id];
+        const size_t capacity = items.capacity();
+        items.push_back({docid, last - first});
+        posting_bytes += (items.capacity() - capacity) * sizeof(Item);
+        max_hits[term_id] = std::max(max_hits[term_id], static_cast<uint32_t>(last - first));
+        first = last;
+    }
+}
+
+void InvertedIndex::Index::Append(Index&& other) {
+    for (uint32_t other_id = 0; other_id < other.terms.Size(); ++other_id) {
+        const uint32_t term_id = terms.Insert(other.terms.Term(other_id));
+        auto& items = other.postings[other_id];
+        if (term_id == postings.size()) {
+            posting_bytes += items.capacity() * sizeof(Item);
+            postings.push_back(std::move(items));
+            max_hits.push_back(other.max_hits[other_id]);
+        } else {
+            const size_t capacity = postings[term_id].capacity();
+            postings[term_id].insert(postings[term_id].end(), items.begin(), items.end());
+            posting_bytes += (postings[term_id].capacity() - capacity) * sizeof(Item);
+            max_hits[term_id] = std::max(max_hits[term_id], other.max_hits[other_id]);
+        }
+    }
+    // vectors moved from `other` still allocate from its pools
+    std::move(other.memory.begin(), other.memory.end(), std::back_inserter(memory));
+}
+
+void InvertedIndex::Index::ReleasePostings() {
+    // the vectors go before the pools they were allocated from
+    std::vector<std::pmr::vector<Item>>().swap(postings);
+    posting_bytes = 0;
+    memory.resize(1);
+    memory.front() = std::make_unique<std::pmr::unsynchronized_pool_resource>();
+}
+
+size_t InvertedIndex::Index::MemoryBytes() const {
+    return PostingBytes() + terms.MemoryBytes();
+}
+
+size_t InvertedIndex::Index::PostingBytes() const {
+    return posting_bytes + postings.capacity() * sizeof(postings[0]) + max_hits.capacity() * sizeof(uint32_t);
+}
+
+InvertedIndex InvertedIndex::Concatenate(const std::vector<const InvertedIndex*>& parts,
+                                         const std::function<bool(size_t)>& is_deleted) {
+    InvertedIndex result;
+    const bool reordered = std::any_of(parts.begin(), parts.end(), [](const InvertedIndex* part) {
+        return part->OriginalDocids() != nullptr;
+    });
+    for (const InvertedIndex* part : parts) {
+        const size_t first_docid = result.GetDocsSize();
+        for (size_t docid = 0; docid < part->GetDocsSize(); ++docid) {
+            result.AppendDocument(is_deleted(first_docid + docid) ? std::string_view() : part->GetDocument(docid));
+        }
+        if (reordered) {
+            const uint32_t* original_docids = part->OriginalDocids();
+            for (size_t docid = 0; docid < part->GetDocsSize(); ++docid) {
+                result.original_docids.push_back(first_docid + (original_docids ? original_docids[docid] : docid));
+            }
+        }
+
+        for (uint32_t part_id = 0; part_id < part->index.terms.Size(); ++part_id) {
+            const uint32_t term_id = result.index.terms.Insert(part->index.terms.Term(part_id));
+            if (term_id == result.index.postings.size()) {
+                result.index.postings.emplace_back(result.index.memory.front().get());
+                result.index.max_hits.push_back(0);
+            }
+            auto& postings = result.index.postings[term_id];
+            auto& max_hits = result.index.max_hits[term_id];
+            const size_t capacity = postings.capacity();
+            part->Postings(part_id).ForEach([&](size_t docid, size_t hits) {
+                if (!is_deleted(first_docid + docid)) {
+                    postings.push_back({first_docid + docid, hits});
+                    max_hits = std::max(max_hits, static_cast<uint32_t>(hits));
+                }
+            });
+            result.index.posting_bytes += (postings.capacity() - capacity) * sizeof(Item);
+        }
+    }
+    result.BuildBlockBounds();
+    return result;
+}
+
+void InvertedIndex::CheckWritable(const char* operation) const {
+    if (mapped) {
+        throw std::logic_error(std::string("InvertedIndex::") + operation + ": index is mapped read-only");
+    }
+}
+
+void InvertedIndex::Add(std::string&& document) {
+    CheckWritable("Add");
+    if (IsFrozen()) {
+        throw std::logic_error("InvertedIndex::Add: postings are already frozen");
+    }
+    AppendDocument(document);
+    if (!original_docids.empty()) {
+        original_docids.push_back(GetDocsSize() - 1);
+    }
+    index.AddDocument(GetDocsSize() - 1, GetDocument(GetDocsSize() - 1));
+    block_max_hits.clear();
+    block_max_offsets.clear();
+}
+
+void InvertedIndex::BuildParallel(size_t threads, size_t memory_limit) {
+    // bytes of the documents and all partial indexes, as last reported by the workers
+    std::atomic<size_t> used = GetMemoryUsage().Total();
+    std::atomic<bool> over_limit = false;
+
+    // every worker indexes a contiguous docid range into its own partial index
+    const size_t docs_num = GetDocsSize();
+    const size_t range_size = (docs_num + threads - 1) / threads;
+    std::vector<std::future<Index>> partials;
+    for (size_t first = 0; first < docs_num; first += range_size) {
+        const size_t last = std::min(first + range_size, docs_num);
+        partials.push_back(std::async(std::launch::async, [this, first, last, memory_limit, &used, &over_limit] {
+            Index partial;
+            size_t reported = 0;
+            for (size_t docid = first; docid < last && !over_limit; ++docid) {
+                partial.AddDocument(docid, GetDocument(docid));
+                if (memory_limit != 0 && (docid - first) % MEMORY_CHECK_DOCS == 0) {
+                    const size_t bytes = partial.MemoryBytes();
+                    if (used.fetch_add(bytes - reported) + bytes - reported > memory_limit) {
+                        over_limit = true;
+                    }
+                    reported = bytes;
+                }
+            }
+            return partial;
+        }));
+    }
+
+    // ranges are merged in docid order, so posting lists and term ids come out
+    // exactly as if the documents were added one by one
+    for (auto& future : partials) {
+        index.Append(future.get());
+        if (over_limit) {
+            // the other workers stop at their next document, their futures wait for them
+            throw MemoryLimitError(memory_limit, "indexing");
+        }
+    }
+}
+
+void InvertedIndex::CheckMemoryLimit(size_t memory_limit, size_t extra_bytes, const char* stage) const {
+    if (memory_limit != 0 && GetMemoryUsage().Total() + extra_bytes > memory_limit) {
+        throw MemoryLimitError(memory_limit, stage);
+    }
+}
+
+IndexMemoryUsage InvertedIndex::GetMemoryUsage() const {
+    IndexMemoryUsage usage;
+    usage.dictionary = index.terms.MemoryBytes();
+    usage.postings = index.PostingBytes()
+                     + frozen_items.capacity() * sizeof(Item) + frozen_lists.capacity() * sizeof(ListRange)
+                     + compressed_blocks.capacity() + compressed_lists.capacity() * sizeof(ListRange)
+                     + block_max_hits.capacity() * sizeof(uint32_t) + block_max_offsets.capacity() * sizeof(uint64_t);
+    usage.documents = texts.capacity() + doc_starts.capacity() * sizeof(uint64_t)
+                      + original_docids.capacity() * sizeof(uint32_t);
+    if (mapped) {
+        usage.mapped = mapped->file->Size();
+    }
+    return usage;
+}
+
+void InvertedIndex::BuildBlockBounds() {
+    block_max_hits.clear();
+    block_max_offsets.assign(1, 0);
+    for (const auto& items : index.postings) {
+        AppendBlockMaxHits(items.data(), items.size(), block_max_hits);
+        block_max_offsets.push_back(block_max_hits.size());
+    }
+}
+
+void InvertedIndex::Compress() {
+    CheckWritable("Compress");
+    if (!compressed_lists.empty()) {
+        return;
+    }
+
+    Freeze();
+    compressed_lists.reserve(frozen_lists.size());
+    for (const ListRange& list : frozen_lists) {
+        compressed_lists.push_back({compressed_blocks.size(), list.size});
+        AppendCompressedPostings(frozen_items.data() + list.offset, list.size, compressed_blocks);
+    }
+    compressed_blocks.shrink_to_fit();
+    std::vector<Item>().swap(frozen_items);
+    std::vector<ListRange>().swap(frozen_lists);
+}
+
+void InvertedIndex::Freeze() {
+    if (IsFrozen()) {
+        return;
+    }
+
+    size_t postings_num = 0;
+    for (const auto& items : index.postings) {
+        postings_num += items.size();
+    }
+    frozen_items.reserve(postings_num);
+    frozen_lists.reserve(index.postings.size() + 1);
+    for (const auto& items : index.postings) {
+        frozen_lists.push_back({frozen_items.size(), items.size()});
+        frozen_items.insert(frozen_items.end(), items.begin(), items.end());
+    }
+    frozen_lists.push_back({frozen_items.size(), 0});
+    index.ReleasePostings();
+}
+
+PostingList InvertedIndex::Postings(uint32_t term_id) const {
+    if (mapped) {
+        const ListRange& list = mapped->lists[term_id];
+        PostingList result = mapped->compressed
+                ? PostingList(mapped->blocks + list.offset, mapped->lists[term_id + 1].offset - list.offset, list.size)
+                : PostingList(mapped->items + list.offset, list.size);
+        return result.SetBounds(mapped->max_hits[term_id], mapped->block_max_hits + mapped->block_max_offsets[term_id]);
+    }
+
+    PostingList result;
+    if (!frozen_lists.empty()) {
+        result = {frozen_items.data() + frozen_lists[term_id].offset, frozen_lists[term_id].size};
+    } else if (compressed_lists.empty()) {
+        const auto& items = index.postings[term_id];
+        result = {items.data(), items.size()};
+    } else {
+        const ListRange& list = compressed_lists[term_id];
+        result = {compressed_blocks.data() + list.offset, compressed_lists[term_id + 1].offset - list.offset, list.size};
+    }
+    return result.SetBounds(index.max_hits[term_id],
+                            block_max_offsets.empty() ? nullptr : block_max_hits.data() + block_max_offsets[term_id]);
+}
+
+PostingList InvertedIndex::Lookup(std::string_view word) const {
+    const uint32_t term_id = index.terms.Find(word);
+    if (term_id == TermDictionary::NOT_FOUND) {
+        return {};
+    }
+    return Postings(term_id);
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include "postings.h"
+#include "term_dictionary.h"
+#include "mapped_file.h"
+
+#include <istream>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+
+struct IndexBuildOptions {
+    // number of threads tokenizing document ranges; 1 builds on the calling thread
+    size_t threads = 1;
+    // store posting lists in the compressed block format (see postings.h)
+    bool compress_postings = false;
+    // Renumber the documents so that ones sharing terms get nearby docids (see
+    // reorder.h): posting gaps shrink and scoring touches fewer cache lines.
+    // OriginalDocids() maps the new docids back to the input lines.
+    bool reorder_documents = false;
+    // The build throws std::runtime_error instead of letting the index take
+    // more heap bytes than this (IndexMemoryUsage::Total); 0 means no limit.
+    // Scratch of the build itself (reordering, tokenizing) is not counted.
+    size_t memory_limit = 0;
+};
+
+// Heap bytes held by an index, per structure. Vectors count with their
+// capacity; allocator overhead is left out.
+struct IndexMemoryUsage {
+    size_t dictionary = 0;  // term hash table, term bytes and their offsets
+    size_t postings = 0;    // posting lists and their hit bounds
+    size_t documents = 0;   // document text, its offsets and the docid map
+    // size of a mapped index file: page cache the kernel may reclaim, not heap
+    size_t mapped = 0;
+
+    size_t Total() const {
+        return dictionary + postings + documents;
+    }
+
+    IndexMemoryUsage& operator+=(const IndexMemoryUsage& other) {
+        dictionary += other.dictionary;
+        postings += other.postings;
+        documents += other.documents;
+        mapped += other.mapped;
+        return *this;
+    }
+};
+
+struct ExternalBuildOptions {
+    // a batch of documents is written out as a run once its dictionary and
+    // postings take this many bytes
+    size_t memory_limit = size_t(256) << 20;
+    // parent of the directory holding runs and document text until the merge
+    // is done; empty means std::filesystem::temp_directory_path()
+    std::string temp_directory;
+    bool compress_postings = false;
+};
+
+class InvertedIndex {
+public:
+    InvertedIndex() = default;
+
+    explicit InvertedIndex(std::istream& document_input, const IndexBuildOptions& options = {});
+
+    // Index stored in a file written by Save(). The file is mapped and used in
+    // place, without parsing; the result is read-only. Throws std::runtime_error
+    // if the file is not a valid index of the current format version.
+    static InvertedIndex Map(const std::string& path, bool verify_checksum = true);
+
+    void Save(const std::string& path) const;
+
+    // Indexes `document_input` straight into an index file for Map() without
+    // holding the corpus in memory. Batches of documents are indexed up to
+    // options.memory_limit, spilled to temporary runs sorted by term and
+    // k-way merged; beyond the batch only the merged dictionary and a few
+    // bytes per term stay in memory. The file has the same documents and
+    // postings as Save() of InvertedIndex(document_input), term ids may differ.
+    static void BuildFile(std::istream& document_input, const std::string& path,
+                          const ExternalBuildOptions& options = {});
+
+    // Documents of all `parts` one after another in a new index. Documents for
+    // which is_deleted(docid) holds (docid as in the result) become empty.
+    static InvertedIndex Concatenate(const std::vector<const InvertedIndex*>& parts,
+                                     const std::function<bool(size_t)>& is_deleted);
+
+    // must not be called once the index is frozen (see IsFrozen())
+    void Add(std::string&& document);
+
+    // replaces the posting vectors with compressed blocks
+    void Compress();
+
+    // Replaces the posting vectors with one contiguous array of all lists, the
+    // same layout as an uncompressed index file. Does nothing if the postings
+    // are compressed, mapped or frozen already.
+    void Freeze();
+
+    bool IsCompressed() const {
+        return mapped ? mapped->compressed : !compressed_lists.empty();
+    }
+
+    // postings are read-only: compressed, frozen or mapped
+    bool IsFrozen() const {
+        return mapped || !compressed_lists.empty() || !frozen_lists.empty();
+    }
+
+    PostingList Lookup(std::string_view word) const;
+
+    std::string_view GetDocument(size_t docid) const {
+        if (mapped) {
+            return {mapped->text + mapped->doc_offsets[docid], mapped->doc_offsets[docid + 1] - mapped->doc_offsets[docid]};
+        }
+        return {texts.data() + doc_starts[docid], doc_starts[docid + 1] - doc_starts[docid] - 1};
+    }
+
+    size_t GetDocsSize() const {
+        return mapped ? mapped->docs : doc_starts.size() - 1;
+    }
+
+    IndexMemoryUsage GetMemoryUsage() const;
+
+    // Line of the input each docid was read from, or nullptr if every docid
+    // is its own line. Documents added later keep their docids.
+    const uint32_t* OriginalDocids() const {
+        if (mapped) {
+            return mapped->original_docids;
+        }
+        return original_docids.empty() ? nullptr : original_docids.data();
+    }
+
+private:
+    // posting list of every term, indexed by its id in the dictionary
+    struct Index {
+        // Posting vectors grow in pools owned by the index instead of the
+        // global heap and are released together when the index is frozen.
+        // Append() takes over the pools of the other index with its vectors,
+        // a copy gets a pool of its own.
+        std::vector<std::unique_ptr<std::pmr::unsynchronized_pool_resource>> memory;
+        TermDictionary terms;
+        std::vector<std::pmr::vector<Item>> postings;
+        // largest hit count in each posting list
+        std::vector<uint32_t> max_hits;
+        // capacity of the posting vectors in bytes
+        size_t posting_bytes = 0;
+
+        Index();
+        Index(const Index& other);
+        Index(Index&& other) = default;
+        Index& operator=(const Index& other);
+        // the vectors go before the pools they were allocated from
+        Index& operator=(Index&& other) noexcept;
+
+        void AddDocument(size_t docid, std::string_view document);
+
+        // appends postings of `other`, whose docids all follow the ones already here
+        void Append(Index&& other);
+
+        // drops the posting vectors and their pools
+        void ReleasePostings();
+
+        // bytes held by the dictionary and the posting vectors, without pool overhead
+        size_t MemoryBytes() const;
+
+        // the posting part of MemoryBytes()
+        size_t PostingBytes() const;
+    };
+
+    // appends the rest of `document_input` to the arena, one document per line
+    void ReadDocuments(std::istream& document_input);
+
+    void AppendDocument(std::string_view document);
+
+    // renumbers the documents read so far in BisectionOrder, before indexing
+    void ReorderDocuments();
+
+    void BuildParallel(size_t threads, size_t memory_limit);
+
+    // throws if the index would hold more than `memory_limit` bytes (0: no
+    // limit) with `extra_bytes` more allocated, about to be during `stage`
+    void CheckMemoryLimit(size_t memory_limit, size_t extra_bytes, const char* stage) const;
+
+    // fills block_max_hits from the final posting lists
+    void BuildBlockBounds();
+
+    void CheckWritable(const char* operation) const;
+
+    PostingList Postings(uint32_t term_id) const;
+
+    // where the postings of a term start (Item index or byte) and how many there are
+    struct ListRange {
+        size_t offset;
+        size_t size;
+    };
+
+    // arrays of an index file used in place, see index_file.h
+    struct MappedStorage {
+        std::shared_ptr<const MappedFile> file;
+        bool compressed;
+        const Item* items;
+        const uint8_t* blocks;
+        const ListRange* lists;
+        const char* text;
+        const uint64_t* doc_offsets;
+        size_t docs;
+        const uint32_t* max_hits;
+        const uint32_t* block_max_hits;
+        const uint64_t* block_max_offsets;
+        const uint32_t* original_docids;  // nullptr if the section is empty
+    };
+
+    Index index;
+
+    // text of all documents back to back, each one followed by '\n'
+    std::string texts;
+    // where every document starts in `texts`, plus the end of the last one
+    std::vector<uint64_t> doc_starts = {0};
+    // set by ReorderDocuments(): input line of every docid
+    std::vector<uint32_t> original_docids;
+
+    // filled by Freeze(): postings of all lists back to back, one entry per term id
+    std::vector<Item> frozen_items;
+    std::vector<ListRange> frozen_lists;
+
+    // filled by Compress(): blocks of all lists back to back, one entry per term id
+    std::vector<uint8_t> compressed_blocks;
+    std::vector<ListRange> compressed_lists;
+
+    // largest hit count of every block of every list, see PostingList; term id
+    // -> first entry in block_max_offsets. Empty after Add(), lists then only
+    // have a bound for the whole list.
+    std::vector<uint32_t> block_max_hits;
+    std::vector<uint64_t> block_max_offsets;
+
+    // set by Map(), replaces the postings and documents above
+    std::optional<MappedStorage> mapped;
+};
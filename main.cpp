@@ -1,12 +1,34 @@
-#include "tests.h"
-
-int main() {
-    TestRunner tr;
-    RUN_TEST(tr, TestSerpFormat);
-    RUN_TEST(tr, TestTop5);
-    RUN_TEST(tr, TestHitcount);
-    RUN_TEST(tr, TestRanking);
-    RUN_TEST(tr, TestBasicSearch);
-    RUN_TEST(tr, TestMultithreading);
-    return 0;
-}
+#include "tests.h"
+
+int main() {
+    TestRunner tr;
+    RUN_TEST(tr, TestSerpFormat);
+    RUN_TEST(tr, TestTop5);
+    RUN_TEST(tr, TestHitcount);
+    RUN_TEST(tr, TestRanking);
+    RUN_TEST(tr, TestBasicSearch);
+    RUN_TEST(tr, TestMultithreading);
+    RUN_TEST(tr, TestSnapshotConsistency);
+    RUN_TEST(tr, TestSelectTopDocs);
+    RUN_TEST(tr, TestParallelIndexBuild);
+    RUN_TEST(tr, TestTermDictionary);
+    RUN_TEST(tr, TestCompressedPostings);
+    RUN_TEST(tr, TestIndexFile);
+    RUN_TEST(tr, TestIncrementalUpdates);
+    RUN_TEST(tr, TestQueryCache);
+    RUN_TEST(tr, TestChunkedQueryStreams);
+    RUN_TEST(tr, TestTokenizer);
+    RUN_TEST(tr, TestDocumentArena);
+    RUN_TEST(tr, TestBinaryResults);
+    RUN_TEST(tr, TestMetrics);
+    RUN_TEST(tr, TestPostingCursor);
+    RUN_TEST(tr, TestMaxScore);
+    RUN_TEST(tr, TestFrozenIndex);
+    RUN_TEST(tr, TestQueryShards);
+    RUN_TEST(tr, TestSearchDaemon);
+    RUN_TEST(tr, TestExternalBuild);
+    RUN_TEST(tr, TestShardCoordinator);
+    RUN_TEST(tr, TestDocumentReordering);
+    RUN_TEST(tr, TestMemoryUsage);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only shared mapping of a whole file; pages are shared with every other
+// process mapping the same file. Unmapped on destruction.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    const char* Data() const {
+        return data;
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+};
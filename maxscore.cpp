@@ -0,0 +1,191 @@
+#include "maxscore.h"
+#include "scoring.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace {
+
+const size_t WINDOW_SIZE = 1024;
+
+struct TermCursor {
+    PostingCursor cursor;
+    size_t weight;  // occurrences of the term in the query
+    size_t bound;   // largest score the term can add to a document
+    size_t prefix;  // sum of `bound` over this cursor and the ones before it
+};
+
+// Offers `candidate` to the bounded heap `top`, whose front is the worst entry.
+void Offer(std::vector<Item>& top, size_t max_docs, Item candidate) {
+    if (top.size() < max_docs) {
+        top.push_back(candidate);
+        std::push_heap(top.begin(), top.end(), IsBetterHit);
+    } else {
+        std::pop_heap(top.begin(), top.end(), IsBetterHit);
+        top.back() = candidate;
+        std::push_heap(top.begin(), top.end(), IsBetterHit);
+    }
+}
+
+// Candidates come in increasing docid order, so one with as many hits as the
+// worst of a full top loses the tie: it has to beat this strictly.
+size_t Threshold(const std::vector<Item>& top, size_t max_docs) {
+    return top.size() < max_docs ? 0 : top.front().hits;
+}
+
+void ScoreSegment(const SegmentedIndex& index, size_t first_docid, std::vector<TermCursor>& terms,
+                  size_t max_docs, std::vector<Item>& top) {
+    std::sort(terms.begin(), terms.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+        return lhs.bound < rhs.bound;
+    });
+    size_t prefix = 0;
+    for (auto& term : terms) {
+        prefix += term.bound;
+        term.prefix = prefix;
+    }
+
+    // terms[0, essential) are the non-essential lists
+    size_t threshold = Threshold(top, max_docs);
+    size_t essential = 0;
+    auto update_essential = [&] {
+        while (essential < terms.size() && terms[essential].prefix <= threshold) {
+            ++essential;
+        }
+    };
+    update_essential();
+
+    // Docids up to region_end lie in the current block of every list, so
+    // their hits are bounded by the sum of those blocks' maxima.
+    bool region_valid = false;
+    size_t region_end = 0;
+    size_t region_bound = 0;
+    size_t region_non_essential_bound = 0;
+    auto start_region = [&](size_t docid) {
+        region_valid = true;
+        region_end = PostingCursor::END;
+        region_bound = 0;
+        region_non_essential_bound = 0;
+        for (size_t i = 0; i < terms.size(); ++i) {
+            PostingCursor& cursor = terms[i].cursor;
+            if (i < essential) {
+                cursor.SkipTo(docid);
+            } else if (cursor.Docid() == PostingCursor::END) {
+                continue;
+            }
+            const size_t bound = cursor.BlockMaxHits() * terms[i].weight;
+            region_bound += bound;
+            if (i < essential) {
+                region_non_essential_bound += bound;
+            }
+            region_end = std::min(region_end, cursor.BlockLastDocid());
+        }
+    };
+
+    // Within a region the essential lists are summed term-at-a-time into a
+    // window of counters, then only the candidates that can still beat the
+    // threshold are looked up in the non-essential lists.
+    // Counters and their occupancy bits are left zeroed after every window.
+    thread_local std::array<uint32_t, WINDOW_SIZE> window{};
+    thread_local std::array<uint64_t, WINDOW_SIZE / 64> occupied{};
+    while (essential < terms.size()) {
+        size_t first = PostingCursor::END;
+        for (size_t i = essential; i < terms.size(); ++i) {
+            first = std::min(first, terms[i].cursor.Docid());
+        }
+        if (first == PostingCursor::END) {
+            break;
+        }
+
+        if (!region_valid || first > region_end) {
+            start_region(first);
+        }
+        if (region_bound <= threshold) {
+            // nothing in the region can get into the top
+            if (region_end == PostingCursor::END) {
+                break;
+            }
+            for (size_t i = essential; i < terms.size(); ++i) {
+                terms[i].cursor.Advance(region_end + 1);
+            }
+            region_valid = false;
+            continue;
+        }
+
+        const size_t last = std::min(region_end, first + WINDOW_SIZE - 1);
+        for (size_t i = essential; i < terms.size(); ++i) {
+            PostingCursor& cursor = terms[i].cursor;
+            for (; cursor.Docid() <= last; cursor.Next()) {
+                const size_t offset = cursor.Docid() - first;
+                window[offset] += cursor.Hits() * terms[i].weight;
+                occupied[offset / 64] |= uint64_t(1) << (offset % 64);
+            }
+        }
+
+        // the window was summed over these lists even if the threshold grows
+        const size_t window_essential = essential;
+        for (size_t word = 0; word <= (last - first) / 64; ++word) {
+            for (uint64_t bits = std::exchange(occupied[word], 0); bits != 0; bits &= bits - 1) {
+                const size_t offset = word * 64 + __builtin_ctzll(bits);
+                const size_t docid = first + offset;
+                size_t hits = std::exchange(window[offset], 0);
+                if (hits + region_non_essential_bound <= threshold || index.IsDeleted(first_docid + docid)) {
+                    continue;
+                }
+                for (size_t i = window_essential; i-- > 0 && hits + terms[i].prefix > threshold; ) {
+                    PostingCursor& cursor = terms[i].cursor;
+                    cursor.Advance(docid);
+                    if (cursor.Docid() == docid) {
+                        hits += cursor.Hits() * terms[i].weight;
+                    }
+                }
+                if (hits > threshold) {
+                    Offer(top, max_docs, {first_docid + docid, hits});
+                    threshold = Threshold(top, max_docs);
+                }
+            }
+        }
+
+        update_essential();
+        if (essential != window_essential) {
+            region_valid = false;
+        }
+    }
+}
+
+}  // namespace
+
+std::vector<Item> SelectTopDocsMaxScore(const SegmentedIndex& index, const std::vector<std::string_view>& words,
+                                        size_t max_docs) {
+    std::vector<Item> top;
+    if (max_docs == 0) {
+        return top;
+    }
+    top.reserve(max_docs);
+
+    // distinct words and how many times each occurs
+    thread_local std::vector<std::string_view> sorted_words;
+    sorted_words.assign(words.begin(), words.end());
+    std::sort(sorted_words.begin(), sorted_words.end());
+
+    thread_local std::vector<TermCursor> terms;
+    for (const auto& [segment, first_docid] : index.GetSegments()) {
+        terms.clear();
+        for (size_t first = 0; first < sorted_words.size(); ) {
+            size_t last = first + 1;
+            while (last < sorted_words.size() && sorted_words[last] == sorted_words[first]) {
+                ++last;
+            }
+            const PostingList list = segment->Lookup(sorted_words[first]);
+            if (list.Size() != 0) {
+                const size_t weight = last - first;
+                terms.push_back({PostingCursor(list), weight, list.MaxHits() * weight, 0});
+            }
+            first = last;
+        }
+        ScoreSegment(index, first_docid, terms, max_docs, top);
+    }
+
+    std::sort_heap(top.begin(), top.end(), IsBetterHit);
+    return top;
+}
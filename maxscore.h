@@ -0,0 +1,17 @@
+#pragma once
+
+#include "postings.h"
+#include "segmented_index.h"
+
+#include <string_view>
+#include <vector>
+
+// Top `max_docs` live documents for the query `words` in IsBetterHit order,
+// the same as SelectTopDocs over fully accumulated hits. Documents are
+// visited in docid windows with the MaxScore strategy: once the top is full,
+// lists whose hit bounds add up to no more than the worst hits in it cannot
+// bring in a new document on their own, so they are only probed for the
+// candidates of the other lists, and candidates whose block bounds cannot
+// beat the top are not probed at all.
+std::vector<Item> SelectTopDocsMaxScore(const SegmentedIndex& index, const std::vector<std::string_view>& words,
+                                        size_t max_docs);
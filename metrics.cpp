@@ -0,0 +1,167 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+const char* CounterName(Counter counter) {
+    switch (counter) {
+        case Counter::QUERIES: return "queries";
+        case Counter::QUERY_CACHE_HITS: return "query_cache_hits";
+        case Counter::DOCUMENTS_ADDED: return "documents_added";
+        case Counter::DOCUMENTS_REMOVED: return "documents_removed";
+        case Counter::SEGMENT_MERGES: return "segment_merges";
+        case Counter::SEGMENT_MERGES_DEFERRED: return "segment_merges_deferred";
+        default: return "unknown";
+    }
+}
+
+const char* GaugeName(Gauge gauge) {
+    switch (gauge) {
+        case Gauge::QUERY_SCRATCH_BYTES: return "query_scratch_bytes";
+        default: return "unknown";
+    }
+}
+
+const char* PhaseName(Phase phase) {
+    switch (phase) {
+        case Phase::QUERY: return "query";
+        case Phase::LOOKUP: return "lookup";
+        case Phase::TOP_K: return "top_k";
+        case Phase::FORMATTING: return "formatting";
+        case Phase::LOCK_WAIT: return "lock_wait";
+        case Phase::INDEX_BUILD: return "index_build";
+        default: return "unknown";
+    }
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return ns;
+    }
+    // the SUB_BUCKET_BITS bits below the highest set one pick the sub-bucket
+    const size_t shift = 63 - __builtin_clzll(ns) - SUB_BUCKET_BITS;
+    const size_t index = (shift + 1) * SUB_BUCKETS + (ns >> shift) - SUB_BUCKETS;
+    return std::min(index, BUCKETS_NUM - 1);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+    if (index < SUB_BUCKETS) {
+        return index;
+    }
+    const size_t shift = index / SUB_BUCKETS - 1;
+    const uint64_t sub_bucket = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+uint64_t LatencyHistogram::Percentile(double q) const {
+    uint64_t total = 0;
+    for (uint64_t bucket : buckets) {
+        total += bucket;
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * total)));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS_NUM; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(BucketUpperBound(i), max_ns);
+        }
+    }
+    return max_ns;
+}
+
+namespace {
+
+std::atomic<uint64_t> next_metrics_id{1};
+
+}  // namespace
+
+Metrics::Metrics() :
+        id(next_metrics_id.fetch_add(1))
+{
+}
+
+Metrics::ThreadSlot& Metrics::Local() {
+    // the slot of the registry this thread used last
+    thread_local uint64_t cached_id = 0;
+    thread_local ThreadSlot* cached_slot = nullptr;
+    if (cached_id != id) {
+        cached_slot = &Register();
+        cached_id = id;
+    }
+    return *cached_slot;
+}
+
+Metrics::ThreadSlot& Metrics::Register() {
+    std::lock_guard<std::mutex> guard(m);
+    auto& slot = slots[std::this_thread::get_id()];
+    if (!slot) {
+        slot = std::make_unique<ThreadSlot>();
+    }
+    return *slot;
+}
+
+void Metrics::Record(Phase phase, std::chrono::steady_clock::duration duration) {
+    const uint64_t ns = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+    auto& slot = Local().phases[size_t(phase)];
+    Bump(slot.count, 1);
+    Bump(slot.sum_ns, ns);
+    if (ns > slot.max_ns.load(std::memory_order_relaxed)) {
+        slot.max_ns.store(ns, std::memory_order_relaxed);
+    }
+    Bump(slot.buckets[LatencyHistogram::BucketIndex(ns)], 1);
+}
+
+Metrics::Snapshot Metrics::Read() const {
+    Snapshot result;
+    std::lock_guard<std::mutex> guard(m);
+    for (const auto& [thread, slot] : slots) {
+        for (size_t i = 0; i < result.counters.size(); ++i) {
+            result.counters[i] += slot->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < result.gauges.size(); ++i) {
+            result.gauges[i] += slot->gauges[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < result.phases.size(); ++i) {
+            const auto& source = slot->phases[i];
+            LatencyHistogram& target = result.phases[i];
+            target.count += source.count.load(std::memory_order_relaxed);
+            target.sum_ns += source.sum_ns.load(std::memory_order_relaxed);
+            target.max_ns = std::max(target.max_ns, source.max_ns.load(std::memory_order_relaxed));
+            for (size_t bucket = 0; bucket < LatencyHistogram::BUCKETS_NUM; ++bucket) {
+                target.buckets[bucket] += source.buckets[bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return result;
+}
+
+std::string Metrics::Snapshot::ToJson() const {
+    std::ostringstream json;
+    json << "{\"counters\": {";
+    for (size_t i = 0; i < counters.size(); ++i) {
+        json << (i ? ", " : "") << '"' << CounterName(Counter(i)) << "\": " << counters[i];
+    }
+    json << "}, \"gauges\": {";
+    for (size_t i = 0; i < gauges.size(); ++i) {
+        json << (i ? ", " : "") << '"' << GaugeName(Gauge(i)) << "\": " << gauges[i];
+    }
+    json << "}, \"phases\": {";
+    for (size_t i = 0; i < phases.size(); ++i) {
+        const LatencyHistogram& histogram = phases[i];
+        json << (i ? ", " : "") << '"' << PhaseName(Phase(i)) << "\": {"
+             << "\"count\": " << histogram.count
+             << ", \"mean_ns\": " << (histogram.count ? histogram.sum_ns / histogram.count : 0)
+             << ", \"p50_ns\": " << histogram.Percentile(0.5)
+             << ", \"p90_ns\": " << histogram.Percentile(0.9)
+             << ", \"p99_ns\": " << histogram.Percentile(0.99)
+             << ", \"p999_ns\": " << histogram.Percentile(0.999)
+             << ", \"max_ns\": " << histogram.max_ns << '}';
+    }
+    json << "}}";
+    return json.str();
+}
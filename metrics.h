@@ -0,0 +1,167 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+enum class Counter {
+    QUERIES,
+    QUERY_CACHE_HITS,
+    DOCUMENTS_ADDED,
+    DOCUMENTS_REMOVED,
+    SEGMENT_MERGES,
+    SEGMENT_MERGES_DEFERRED,  // merges put off for the memory budget
+    COUNTERS_NUM,
+};
+
+// Current values, kept per thread and summed over the threads by Read().
+enum class Gauge {
+    QUERY_SCRATCH_BYTES,  // hit counters and word lists of the threads answering queries
+    GAUGES_NUM,
+};
+
+// Timed phases. Hits are accumulated while the postings are walked, so
+// LOOKUP covers both the traversal and the scoring of a query.
+enum class Phase {
+    QUERY,        // one query end to end, cache lookup included
+    LOOKUP,       // walking postings and accumulating hits
+    TOP_K,        // selecting the best documents
+    FORMATTING,   // formatting the answers of a chunk
+    LOCK_WAIT,    // waiting for the output stream of a query stream
+    INDEX_BUILD,  // building an index or a merged segment
+    PHASES_NUM,
+};
+
+const char* CounterName(Counter counter);
+const char* GaugeName(Gauge gauge);
+const char* PhaseName(Phase phase);
+
+// Log-linear histogram in the spirit of HdrHistogram: every power of two
+// range of nanoseconds is split into 16 equal buckets, so a percentile is
+// reported with at most 1/16 relative error.
+struct LatencyHistogram {
+    static constexpr size_t SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKETS = size_t(1) << SUB_BUCKET_BITS;
+    // the last bucket takes everything from 2^40 ns (about 18 minutes) up
+    static constexpr size_t MAX_BITS = 40;
+    static constexpr size_t BUCKETS_NUM = (MAX_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    static size_t BucketIndex(uint64_t ns);
+    // largest value falling into bucket `index`
+    static uint64_t BucketUpperBound(size_t index);
+
+    // value at quantile `q` in [0, 1], 0 for an empty histogram
+    uint64_t Percentile(double q) const;
+
+    uint64_t count = 0;
+    uint64_t sum_ns = 0;
+    uint64_t max_ns = 0;
+    std::array<uint64_t, BUCKETS_NUM> buckets = {};
+};
+
+// Counters and latency histograms of one server. Every thread writes only
+// its own slot, with relaxed atomic stores and no read-modify-write, so
+// recording costs a few uncontended memory operations. Read() merges the
+// slots of all threads that have recorded anything.
+class Metrics {
+public:
+    struct Snapshot {
+        std::array<uint64_t, size_t(Counter::COUNTERS_NUM)> counters = {};
+        std::array<uint64_t, size_t(Gauge::GAUGES_NUM)> gauges = {};
+        std::array<LatencyHistogram, size_t(Phase::PHASES_NUM)> phases;
+
+        uint64_t Get(Counter counter) const {
+            return counters[size_t(counter)];
+        }
+
+        uint64_t Get(Gauge gauge) const {
+            return gauges[size_t(gauge)];
+        }
+
+        const LatencyHistogram& Get(Phase phase) const {
+            return phases[size_t(phase)];
+        }
+
+        // {"counters": {"queries": 3, ...}, "gauges": {...},
+        //  "phases": {"query": {"count": 3, "p50_ns": ...}, ...}}
+        std::string ToJson() const;
+    };
+
+    Metrics();
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    void Add(Counter counter, uint64_t delta = 1) {
+        Bump(Local().counters[size_t(counter)], delta);
+    }
+
+    // sets the calling thread's share of `gauge`
+    void Set(Gauge gauge, uint64_t value) {
+        Local().gauges[size_t(gauge)].store(value, std::memory_order_relaxed);
+    }
+
+    void Record(Phase phase, std::chrono::steady_clock::duration duration);
+
+    Snapshot Read() const;
+
+private:
+    struct ThreadSlot {
+        std::array<std::atomic<uint64_t>, size_t(Counter::COUNTERS_NUM)> counters = {};
+        std::array<std::atomic<uint64_t>, size_t(Gauge::GAUGES_NUM)> gauges = {};
+        struct PhaseSlot {
+            std::atomic<uint64_t> count{0};
+            std::atomic<uint64_t> sum_ns{0};
+            std::atomic<uint64_t> max_ns{0};
+            std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKETS_NUM> buckets = {};
+        };
+        std::array<PhaseSlot, size_t(Phase::PHASES_NUM)> phases;
+    };
+
+    // only the owning thread writes a slot
+    static void Bump(std::atomic<uint64_t>& value, uint64_t delta) {
+        value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+    }
+
+    ThreadSlot& Local();
+
+    ThreadSlot& Register();
+
+    const uint64_t id;  // unique per registry, tells thread-local caches apart
+
+    mutable std::mutex m;
+    std::unordered_map<std::thread::id, std::unique_ptr<ThreadSlot>> slots;
+};
+
+// Records the time from construction to destruction as a sample of `phase`.
+class ScopedTimer {
+public:
+    ScopedTimer(Metrics& metrics, Phase phase) :
+            metrics(metrics),
+            phase(phase),
+            start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~ScopedTimer() {
+        metrics.Record(phase, std::chrono::steady_clock::now() - start);
+    }
+
+private:
+    Metrics& metrics;
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+#define METRICS_UNIQ_ID_IMPL(lineno) _a_scoped_timer_##lineno
+#define METRICS_UNIQ_ID(lineno) METRICS_UNIQ_ID_IMPL(lineno)
+
+#define RECORD_DURATION(metrics, phase) \
+    ScopedTimer METRICS_UNIQ_ID(__LINE__){metrics, phase};
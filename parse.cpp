@@ -1,41 +1,85 @@
-#include "parse.h"
-
-//#include <iterator>
-
-std::string_view Strip(std::string_view sv) {
-    while (!sv.empty() && isspace(sv.front())) {
-        sv.remove_prefix(1);
-    }
-    while (!sv.empty() && isspace(sv.back())) {
-        sv.remove_suffix(1);
-    }
-    return sv;
-}
-
-void LeftStrip(std::string_view& sv, char sep) {
-    while (!sv.empty() && sv.front() == sep) {
-        sv.remove_prefix(1);
-    }
-}
-
-std::vector<std::string_view> SplitBy(std::string_view sv, char sep) {
-    std::vector<std::string_view> result;
-    while (!sv.empty()) {
-        size_t sep_pos = sv.find(sep);
-        result.push_back(sv.substr(0, sep_pos));
-        sv.remove_prefix(sep_pos != sv.npos ? sep_pos + 1 : sv.size());
-    }
-    return result;
-}
-
-std::vector<std::string_view> SplitIntoWordsView(std::string_view sv, char sep) {
-    std::vector<std::string_view> result;
-    LeftStrip(sv, sep);
-    while (!sv.empty()) {
-        size_t sep_pos = sv.find(sep);
-        result.push_back(sv.substr(0, sep_pos));
-        sv.remove_prefix(sep_pos != sv.npos ? sep_pos + 1 : sv.size());
-        LeftStrip(sv, sep);
-    }
-    return result;
-}
\ No newline at end of file
+#include "parse.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#ifdef __SSE2__
+
+// Scans 16 bytes at a time for the first byte that is (`equal`) or is not
+// (!`equal`) `sep`; the last partial block is left to the scalar loop.
+size_t FindVector(std::string_view sv, size_t pos, char sep, bool equal) {
+    const __m128i pattern = _mm_set1_epi8(sep);
+    const unsigned flip = equal ? 0 : 0xFFFF;
+    for (; pos + 16 <= sv.size(); pos += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sv.data() + pos));
+        const unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, pattern))) ^ flip;
+        if (mask != 0) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return pos;
+}
+
+#else
+
+size_t FindVector(std::string_view, size_t pos, char, bool) {
+    return pos;
+}
+
+#endif
+
+size_t Find(std::string_view sv, size_t pos, char sep, bool equal) {
+    pos = FindVector(sv, pos, sep, equal);
+    while (pos < sv.size() && (sv[pos] == sep) != equal) {
+        ++pos;
+    }
+    return pos;
+}
+
+}  // namespace
+
+std::string_view Strip(std::string_view sv) {
+    while (!sv.empty() && isspace(sv.front())) {
+        sv.remove_prefix(1);
+    }
+    while (!sv.empty() && isspace(sv.back())) {
+        sv.remove_suffix(1);
+    }
+    return sv;
+}
+
+size_t FindSeparator(std::string_view sv, size_t pos, char sep) {
+    return Find(sv, pos, sep, true);
+}
+
+size_t SkipSeparators(std::string_view sv, size_t pos, char sep) {
+    // words are usually separated by a single space, so check that first
+    if (pos < sv.size() && sv[pos] != sep) {
+        return pos;
+    }
+    if (pos + 1 < sv.size() && sv[pos + 1] != sep) {
+        return pos + 1;
+    }
+    return Find(sv, pos, sep, false);
+}
+
+std::vector<std::string_view> SplitBy(std::string_view sv, char sep) {
+    std::vector<std::string_view> result;
+    for (size_t pos = 0; pos < sv.size(); ) {
+        const size_t end = FindSeparator(sv, pos, sep);
+        result.push_back(sv.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    return result;
+}
+
+std::vector<std::string_view> SplitIntoWordsView(std::string_view line, char sep) {
+    std::vector<std::string_view> result;
+    ForEachWord(line, [&result](std::string_view word) {
+        result.push_back(word);
+    }, sep);
+    return result;
+}
@@ -1,25 +1,40 @@
-#pragma once
-
-#include "iterator_range.h"
-
-#include <string_view>
-#include <sstream>
-#include <vector>
-
-template<typename Container>
-std::string Join(char sep, const Container& cont) {
-    std::ostringstream os;
-    for (const auto& item : Head(cont, cont.size() - 1)) {
-        os << item << sep;
-    }
-    os << *rbegin(cont);
-    return os.str();
-}
-
-std::string_view Strip(std::string_view sv);
-
-std::vector<std::string_view> SplitBy(std::string_view sv, char sep = ' ');
-
-std::vector<std::string_view> SplitIntoWordsView(std::string_view line, char sep = ' ');
-
-
+#pragma once
+
+#include "iterator_range.h"
+
+#include <string_view>
+#include <sstream>
+#include <vector>
+
+template<typename Container>
+std::string Join(char sep, const Container& cont) {
+    std::ostringstream os;
+    for (const auto& item : Head(cont, cont.size() - 1)) {
+        os << item << sep;
+    }
+    os << *rbegin(cont);
+    return os.str();
+}
+
+std::string_view Strip(std::string_view sv);
+
+// Position of the first `sep` in `sv` at or after `pos`, or sv.size().
+size_t FindSeparator(std::string_view sv, size_t pos, char sep);
+
+// Position of the first byte other than `sep` in `sv` at or after `pos`, or sv.size().
+size_t SkipSeparators(std::string_view sv, size_t pos, char sep);
+
+// Calls callback(word) for every maximal run of bytes other than `sep` in
+// `line`, in order. Allocates nothing; words point into `line`.
+template<typename Callback>
+void ForEachWord(std::string_view line, Callback callback, char sep = ' ') {
+    for (size_t pos = SkipSeparators(line, 0, sep); pos < line.size(); ) {
+        const size_t end = FindSeparator(line, pos, sep);
+        callback(line.substr(pos, end - pos));
+        pos = SkipSeparators(line, end, sep);
+    }
+}
+
+std::vector<std::string_view> SplitBy(std::string_view sv, char sep = ' ');
+
+std::vector<std::string_view> SplitIntoWordsView(std::string_view line, char sep = ' ');
@@ -0,0 +1,269 @@
+#include "postings.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const size_t BLOCK_HEADER_SIZE = sizeof(uint32_t) + 2;
+
+uint8_t ByteWidth(uint32_t max_value) {
+    return max_value <= UINT8_MAX ? 1 : max_value <= UINT16_MAX ? 2 : 4;
+}
+
+void AppendValue(uint32_t value, uint8_t width, std::vector<uint8_t>& out) {
+    for (uint8_t byte = 0; byte < width; ++byte) {
+        out.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+    }
+}
+
+// blocks keep docids and hit counts in 32 bits
+void CheckFitsBlock(size_t value, const char* what) {
+    if (value > std::numeric_limits<uint32_t>::max()) {
+        throw std::overflow_error(std::string("AppendCompressedPostings: ") + what + " " + std::to_string(value)
+                                  + " does not fit in 32 bits");
+    }
+}
+
+uint32_t ReadValue(const uint8_t* data, uint8_t width) {
+    uint32_t value = 0;
+    for (uint8_t byte = 0; byte < width; ++byte) {
+        value |= uint32_t(data[byte]) << (8 * byte);
+    }
+    return value;
+}
+
+void DecodeScalar(const uint8_t* data, uint8_t width, size_t count, uint32_t* out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = ReadValue(data + i * width, width);
+    }
+}
+
+#ifdef __SSE2__
+
+// Widens `count` little endian values of `width` bytes to uint32_t, four at a time.
+void DecodeVector(const uint8_t* data, uint8_t width, size_t count, uint32_t* out) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    if (width == 1) {
+        for (; i + 16 <= count; i += 16) {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            const __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            const __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 12), _mm_unpackhi_epi16(high, zero));
+        }
+    } else if (width == 2) {
+        for (; i + 8 <= count; i += 8) {
+            const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 2 * i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(words, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(words, zero));
+        }
+    } else {
+        std::memcpy(out, data, 4 * count);
+        return;
+    }
+    DecodeScalar(data + i * width, width, count - i, out + i);
+}
+
+// In-place inclusive prefix sum starting from `base`.
+void PrefixSum(uint32_t base, size_t count, uint32_t* values) {
+    __m128i carry = _mm_set1_epi32(static_cast<int>(base));
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), x);
+        carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    uint32_t running = static_cast<uint32_t>(_mm_cvtsi128_si32(carry));
+    for (; i < count; ++i) {
+        running += values[i];
+        values[i] = running;
+    }
+}
+
+#else
+
+void DecodeVector(const uint8_t* data, uint8_t width, size_t count, uint32_t* out) {
+    DecodeScalar(data, width, count, out);
+}
+
+void PrefixSum(uint32_t base, size_t count, uint32_t* values) {
+    for (size_t i = 0; i < count; ++i) {
+        base += values[i];
+        values[i] = base;
+    }
+}
+
+#endif
+
+}  // namespace
+
+void AppendCompressedPostings(const Item* items, size_t size, std::vector<uint8_t>& out, uint32_t base) {
+    for (size_t first = 0; first < size; first += POSTING_BLOCK_SIZE) {
+        const size_t last = std::min(first + POSTING_BLOCK_SIZE, size);
+
+        uint32_t max_delta = 0;
+        uint32_t max_hits = 0;
+        uint32_t previous = base;
+        for (size_t i = first; i < last; ++i) {
+            CheckFitsBlock(items[i].docid, "docid");
+            CheckFitsBlock(items[i].hits, "hit count");
+            max_delta = std::max(max_delta, static_cast<uint32_t>(items[i].docid) - previous);
+            max_hits = std::max(max_hits, static_cast<uint32_t>(items[i].hits));
+            previous = static_cast<uint32_t>(items[i].docid);
+        }
+        const uint8_t docid_width = ByteWidth(max_delta);
+        const uint8_t hits_width = ByteWidth(max_hits);
+
+        AppendValue(base, sizeof(uint32_t), out);
+        out.push_back(docid_width);
+        out.push_back(hits_width);
+        previous = base;
+        for (size_t i = first; i < last; ++i) {
+            AppendValue(static_cast<uint32_t>(items[i].docid) - previous, docid_width, out);
+            previous = static_cast<uint32_t>(items[i].docid);
+        }
+        for (size_t i = first; i < last; ++i) {
+            AppendValue(static_cast<uint32_t>(items[i].hits), hits_width, out);
+        }
+        base = previous;
+    }
+}
+
+const uint8_t* DecodePostingBlock(const uint8_t* block, size_t count, uint32_t* docids, uint32_t* hits) {
+    const uint32_t base = ReadValue(block, sizeof(uint32_t));
+    const uint8_t docid_width = block[sizeof(uint32_t)];
+    const uint8_t hits_width = block[sizeof(uint32_t) + 1];
+    block += BLOCK_HEADER_SIZE;
+
+    DecodeVector(block, docid_width, count, docids);
+    PrefixSum(base, count, docids);
+    block += count * docid_width;
+
+    DecodeVector(block, hits_width, count, hits);
+    return block + count * hits_width;
+}
+
+const uint8_t* SkipPostingBlock(const uint8_t* block, size_t count) {
+    const uint8_t docid_width = block[sizeof(uint32_t)];
+    const uint8_t hits_width = block[sizeof(uint32_t) + 1];
+    return block + BLOCK_HEADER_SIZE + count * (docid_width + hits_width);
+}
+
+uint32_t PostingBlockBase(const uint8_t* block) {
+    return ReadValue(block, sizeof(uint32_t));
+}
+
+void AppendBlockMaxHits(const Item* items, size_t size, std::vector<uint32_t>& out) {
+    for (size_t first = 0; first < size; first += POSTING_BLOCK_SIZE) {
+        const size_t last = std::min(first + POSTING_BLOCK_SIZE, size);
+        uint32_t max_hits = 0;
+        for (size_t i = first; i < last; ++i) {
+            max_hits = std::max(max_hits, static_cast<uint32_t>(items[i].hits));
+        }
+        out.push_back(max_hits);
+    }
+}
+
+std::vector<Item> PostingList::ToVector() const {
+    std::vector<Item> result;
+    result.reserve(size);
+    ForEach([&result](size_t docid, size_t hits) {
+        result.push_back({docid, hits});
+    });
+    return result;
+}
+
+PostingCursor::PostingCursor(const PostingList& list) :
+        list(list),
+        blocks_num(list.BlocksNum()),
+        block_data(list.Blocks())
+{
+    Load();
+}
+
+size_t PostingCursor::BlockLastDocid() const {
+    if (block + 1 >= blocks_num) {
+        return END;
+    }
+    if (list.IsCompressed()) {
+        // the next block's base is the last docid of this one
+        return PostingBlockBase(SkipPostingBlock(block_data, POSTING_BLOCK_SIZE));
+    }
+    return list.Items()[(block + 1) * POSTING_BLOCK_SIZE - 1].docid;
+}
+
+void PostingCursor::AdvanceSlow(size_t target) {
+    SkipBlocks(target);
+    Load();
+    if (docid >= target) {
+        return;
+    }
+
+    // the block holds the answer unless it is the last one and ends before `target`
+    const size_t first = block * POSTING_BLOCK_SIZE;
+    const size_t last = std::min(first + POSTING_BLOCK_SIZE, list.Size());
+    if (!list.IsCompressed()) {
+        const Item* items = list.Items();
+        index = std::lower_bound(items + index, items + last, target, [](const Item& item, size_t value) {
+            return item.docid < value;
+        }) - items;
+    } else {
+        index = std::lower_bound(block_docids + (index - first), block_docids + (last - first), target)
+                - block_docids + first;
+    }
+    Load();
+}
+
+void PostingCursor::SkipBlocks(size_t target) {
+    while (BlockLastDocid() < target) {
+        if (list.IsCompressed()) {
+            block_data = SkipPostingBlock(block_data, POSTING_BLOCK_SIZE);
+        }
+        ++block;
+        loaded_end = 0;
+    }
+}
+
+void PostingCursor::Load() {
+    // postings before `block` were skipped
+    index = std::max(index, block * POSTING_BLOCK_SIZE);
+    if (index >= list.Size()) {
+        docid = END;
+        hits = 0;
+        loaded_end = 0;
+        return;
+    }
+
+    if (!list.IsCompressed()) {
+        block = index / POSTING_BLOCK_SIZE;
+        loaded_end = std::min((block + 1) * POSTING_BLOCK_SIZE, list.Size());
+        docid = list.Items()[index].docid;
+        hits = list.Items()[index].hits;
+        return;
+    }
+
+    for (; block < index / POSTING_BLOCK_SIZE; ++block) {
+        block_data = SkipPostingBlock(block_data, POSTING_BLOCK_SIZE);
+    }
+    if (decoded_block != block) {
+        const size_t count = std::min(POSTING_BLOCK_SIZE, list.Size() - block * POSTING_BLOCK_SIZE);
+        DecodePostingBlock(block_data, count, block_docids, block_hits);
+        decoded_block = block;
+    }
+    loaded_end = std::min((block + 1) * POSTING_BLOCK_SIZE, list.Size());
+    docid = block_docids[index % POSTING_BLOCK_SIZE];
+    hits = block_hits[index % POSTING_BLOCK_SIZE];
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct Item {
+    size_t docid;
+    size_t hits;
+};
+
+// Compressed postings are split into blocks of POSTING_BLOCK_SIZE entries.
+// A block is
+//     uint32_t base        docid preceding the block (0 for the first one)
+//     uint8_t  docid_width bytes per docid delta: 1, 2 or 4
+//     uint8_t  hits_width  bytes per hit count: 1, 2 or 4
+//     deltas               count * docid_width bytes, little endian
+//     hits                 count * hits_width bytes, little endian
+// where count is POSTING_BLOCK_SIZE for all but the last block of a list.
+// Docids and hit counts must fit into 32 bits.
+constexpr size_t POSTING_BLOCK_SIZE = 128;
+
+// Appends `items` (sorted by docid) to `out` in the block format above. A list
+// can be appended in pieces of whole blocks, `base` being the last docid before the piece.
+// Throws std::overflow_error if a docid or hit count does not fit in 32 bits.
+void AppendCompressedPostings(const Item* items, size_t size, std::vector<uint8_t>& out, uint32_t base = 0);
+
+// Decodes one block of `count` postings; returns the start of the next block.
+// Uses SSE2 when available and a scalar loop otherwise.
+const uint8_t* DecodePostingBlock(const uint8_t* block, size_t count, uint32_t* docids, uint32_t* hits);
+
+// Start of the block after `block` of `count` postings, read from its header only.
+const uint8_t* SkipPostingBlock(const uint8_t* block, size_t count);
+
+// Docid preceding `block`, i.e. the last docid of the block before it.
+uint32_t PostingBlockBase(const uint8_t* block);
+
+// Largest hit count of every POSTING_BLOCK_SIZE postings of `items`, appended to `out`.
+void AppendBlockMaxHits(const Item* items, size_t size, std::vector<uint32_t>& out);
+
+// Read-only view of one term's postings, either a plain Item array or a
+// stream of compressed blocks. Cheap to copy; the storage belongs to the index.
+// It may carry upper bounds of the hit counts, for the whole list and per
+// block of POSTING_BLOCK_SIZE postings; without them every bound is UNKNOWN_HITS.
+class PostingList {
+public:
+    static constexpr uint32_t UNKNOWN_HITS = UINT32_MAX;
+
+    PostingList() = default;
+
+    PostingList(const Item* items, size_t size) :
+            items(items),
+            size(size)
+    {
+    }
+
+    PostingList(const uint8_t* blocks, size_t bytes, size_t size) :
+            blocks(blocks),
+            bytes(bytes),
+            size(size)
+    {
+    }
+
+    size_t Size() const {
+        return size;
+    }
+
+    bool IsCompressed() const {
+        return blocks != nullptr;
+    }
+
+    // storage behind the list: Items() of a plain list, Blocks() of a compressed one
+    const Item* Items() const {
+        return items;
+    }
+
+    const uint8_t* Blocks() const {
+        return blocks;
+    }
+
+    // `block_max_hits` holds one entry per block and may be null
+    PostingList& SetBounds(uint32_t max_hits, const uint32_t* block_max_hits) {
+        this->max_hits = max_hits;
+        this->block_max_hits = block_max_hits;
+        return *this;
+    }
+
+    uint32_t MaxHits() const {
+        return max_hits;
+    }
+
+    uint32_t BlockMaxHits(size_t block) const {
+        return block_max_hits ? block_max_hits[block] : max_hits;
+    }
+
+    size_t BlocksNum() const {
+        return (size + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+    }
+
+    // bytes of storage behind the list
+    size_t MemoryBytes() const {
+        return IsCompressed() ? bytes : size * sizeof(Item);
+    }
+
+    // calls callback(docid, hits) for every posting in docid order
+    template<typename Callback>
+    void ForEach(Callback callback) const {
+        if (!IsCompressed()) {
+            for (const Item* item = items; item != items + size; ++item) {
+                callback(item->docid, item->hits);
+            }
+            return;
+        }
+
+        uint32_t docids[POSTING_BLOCK_SIZE];
+        uint32_t hits[POSTING_BLOCK_SIZE];
+        const uint8_t* block = blocks;
+        for (size_t first = 0; first < size; first += POSTING_BLOCK_SIZE) {
+            const size_t count = std::min(POSTING_BLOCK_SIZE, size - first);
+            block = DecodePostingBlock(block, count, docids, hits);
+            for (size_t i = 0; i < count; ++i) {
+                callback(size_t(docids[i]), size_t(hits[i]));
+            }
+        }
+    }
+
+    std::vector<Item> ToVector() const;
+
+private:
+    const Item* items = nullptr;
+    const uint8_t* blocks = nullptr;
+    size_t bytes = 0;
+    size_t size = 0;
+    uint32_t max_hits = UNKNOWN_HITS;
+    const uint32_t* block_max_hits = nullptr;
+};
+
+// Forward-only position in a PostingList that can skip ahead by docid.
+// Compressed blocks are decoded only when a posting in them is looked at;
+// skipping over a block reads just its header.
+class PostingCursor {
+public:
+    static constexpr size_t END = SIZE_MAX;
+
+    explicit PostingCursor(const PostingList& list);
+
+    // docid of the current posting, END past the last one
+    size_t Docid() const {
+        return docid;
+    }
+
+    size_t Hits() const {
+        return hits;
+    }
+
+    void Next() {
+        if (++index < loaded_end) {
+            if (list.IsCompressed()) {
+                docid = block_docids[index % POSTING_BLOCK_SIZE];
+                hits = block_hits[index % POSTING_BLOCK_SIZE];
+            } else {
+                docid = list.Items()[index].docid;
+                hits = list.Items()[index].hits;
+            }
+        } else {
+            Load();
+        }
+    }
+
+    // moves to the first posting with docid >= target
+    void Advance(size_t target) {
+        if (docid < target) {
+            AdvanceSlow(target);
+        }
+    }
+
+    // Moves to the block that would contain `target` without decoding it, so
+    // Docid() and Hits() are only valid again after the next Advance().
+    // Later calls must not ask about smaller docids.
+    void SkipTo(size_t target) {
+        SkipBlocks(target);
+    }
+
+    // Bounds of the current block: no posting of the list between the
+    // previous block and BlockLastDocid() has more than BlockMaxHits() hits.
+    // The last block extends to END.
+    uint32_t BlockMaxHits() const {
+        return list.BlockMaxHits(block);
+    }
+
+    size_t BlockLastDocid() const;
+
+private:
+    void AdvanceSlow(size_t target);
+
+    // moves `block` to the first block that may contain `target`
+    void SkipBlocks(size_t target);
+
+    // sets docid and hits for `index`, decoding its block if needed
+    void Load();
+
+    PostingList list;
+    size_t blocks_num;
+    size_t index = 0;
+    size_t loaded_end = 0;              // Next() within [index, loaded_end) needs no Load()
+    size_t block = 0;
+    const uint8_t* block_data;          // compressed: start of `block`
+    size_t decoded_block = END;         // compressed: block held in the arrays below
+    size_t docid = END;
+    size_t hits = 0;
+    uint32_t block_docids[POSTING_BLOCK_SIZE];
+    uint32_t block_hits[POSTING_BLOCK_SIZE];
+};
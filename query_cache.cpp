@@ -0,0 +1,97 @@
+#include "query_cache.h"
+
+#include <algorithm>
+#include <functional>
+
+QueryCache::QueryCache(size_t capacity, size_t shards_num) :
+        shard_capacity(capacity == 0 ? 0 : (capacity + shards_num - 1) / shards_num)
+{
+    for (size_t i = 0; i < shards_num; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::string QueryCache::MakeKey(std::vector<std::string_view> words) {
+    std::sort(words.begin(), words.end());
+
+    std::string key;
+    for (auto word : words) {
+        key.append(word.data(), word.size());
+        key += ' ';
+    }
+    return key;
+}
+
+QueryCache::Shard& QueryCache::GetShard(const std::string& key) {
+    return *shards[std::hash<std::string>()(key) % shards.size()];
+}
+
+bool QueryCache::Find(const std::string& key, uint64_t generation, std::vector<Item>& top_docs) {
+    if (shard_capacity == 0) {
+        return false;
+    }
+
+    Shard& shard = GetShard(key);
+    {
+        std::lock_guard<std::mutex> guard(shard.m);
+        if (auto it = shard.by_key.find(key); it != shard.by_key.end()) {
+            auto entry = it->second;
+            if (entry->generation == generation) {
+                shard.entries.splice(shard.entries.begin(), shard.entries, entry);
+                top_docs = entry->top_docs;
+                hits.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            // a stream still answering on an older snapshot must not drop
+            // what the streams on the current one have cached
+            if (entry->generation < generation) {
+                shard.by_key.erase(it);
+                shard.entries.erase(entry);
+            }
+        }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void QueryCache::Insert(const std::string& key, uint64_t generation, const std::vector<Item>& top_docs) {
+    if (shard_capacity == 0) {
+        return;
+    }
+
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> guard(shard.m);
+    if (auto it = shard.by_key.find(key); it != shard.by_key.end()) {
+        // another stream computed it meanwhile; keep the newer generation
+        if (it->second->generation < generation) {
+            it->second->generation = generation;
+            it->second->top_docs = top_docs;
+        }
+        return;
+    }
+
+    shard.entries.push_front({key, generation, top_docs});
+    shard.by_key.emplace(shard.entries.front().key, shard.entries.begin());
+    if (shard.entries.size() > shard_capacity) {
+        shard.by_key.erase(shard.entries.back().key);
+        shard.entries.pop_back();
+    }
+}
+
+size_t QueryCache::EntryBytes(const Entry& entry) {
+    // a list node with two links, a hash node with a link and the key view, a bucket
+    return sizeof(Entry) + 2 * sizeof(void*) + entry.key.capacity() + entry.top_docs.capacity() * sizeof(Item)
+           + sizeof(void*) + sizeof(std::pair<std::string_view, std::list<Entry>::iterator>) + sizeof(void*);
+}
+
+size_t QueryCache::MemoryBytes() const {
+    size_t bytes = shards.capacity() * sizeof(shards[0]);
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard->m);
+        bytes += sizeof(Shard);
+        for (const Entry& entry : shard->entries) {
+            bytes += EntryBytes(entry);
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "postings.h"
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Top documents of recent queries, shared by all query streams.
+// Entries are keyed by the normalized query and remember the index generation
+// they were computed on; looking one up with a newer generation drops it,
+// so publishing a new index invalidates the whole cache without touching it,
+// while a lookup with an older generation is only a miss.
+// The key space is split between shards with a mutex and an LRU list each.
+class QueryCache {
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+    };
+
+    // capacity 0 disables the cache
+    explicit QueryCache(size_t capacity, size_t shards_num = 16);
+
+    // the words' multiset: queries differing only in word order or spacing share a key
+    static std::string MakeKey(std::vector<std::string_view> words);
+
+    bool Find(const std::string& key, uint64_t generation, std::vector<Item>& top_docs);
+
+    void Insert(const std::string& key, uint64_t generation, const std::vector<Item>& top_docs);
+
+    // heap bytes of the entries and their index, roughly: node overhead is estimated
+    size_t MemoryBytes() const;
+
+    Stats GetStats() const {
+        return {hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        uint64_t generation;
+        std::vector<Item> top_docs;
+    };
+
+    struct Shard {
+        std::mutex m;
+        std::list<Entry> entries;   // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> by_key;
+    };
+
+    Shard& GetShard(const std::string& key);
+
+    static size_t EntryBytes(const Entry& entry);
+
+    const size_t shard_capacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<uint64_t> hits = 0;
+    std::atomic<uint64_t> misses = 0;
+};
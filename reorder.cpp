@@ -0,0 +1,132 @@
+#include "reorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+namespace {
+
+// swap rounds per split; a round without profitable swaps ends the split early
+const size_t BISECTION_ITERATIONS = 20;
+// partitions this small keep their order
+const size_t MIN_PARTITION_SIZE = 16;
+
+class Bisection {
+public:
+    Bisection(const std::vector<uint32_t>& terms, const std::vector<size_t>& starts, size_t terms_num) :
+            terms(terms),
+            starts(starts),
+            left_degrees(terms_num, 0),
+            right_degrees(terms_num, 0),
+            log2s(starts.size() + 1, 0)
+    {
+        for (size_t i = 1; i < log2s.size(); ++i) {
+            log2s[i] = std::log2(static_cast<float>(i));
+        }
+    }
+
+    void Split(uint32_t* begin, uint32_t* end) {
+        const size_t size = end - begin;
+        if (size <= MIN_PARTITION_SIZE) {
+            return;
+        }
+        uint32_t* middle = begin + size / 2;
+        const float log_left = log2s[middle - begin];
+        const float log_right = log2s[end - middle];
+
+        for (const uint32_t* doc = begin; doc != end; ++doc) {
+            auto& degrees = doc < middle ? left_degrees : right_degrees;
+            ForEachTerm(*doc, [&degrees](uint32_t term) {
+                ++degrees[term];
+            });
+        }
+
+        for (size_t iteration = 0; iteration < BISECTION_ITERATIONS; ++iteration) {
+            // gain of moving each document to the other half
+            left_gains.clear();
+            right_gains.clear();
+            for (const uint32_t* doc = begin; doc != end; ++doc) {
+                const bool left = doc < middle;
+                float gain = 0;
+                ForEachTerm(*doc, [&](uint32_t term) {
+                    const uint32_t from = left ? left_degrees[term] : right_degrees[term];
+                    const uint32_t to = left ? right_degrees[term] : left_degrees[term];
+                    const float log_from = left ? log_left : log_right;
+                    const float log_to = left ? log_right : log_left;
+                    gain += Cost(from, log_from) + Cost(to, log_to) - Cost(from - 1, log_from) - Cost(to + 1, log_to);
+                });
+                (left ? left_gains : right_gains).emplace_back(gain, *doc);
+            }
+            auto by_gain = [](const std::pair<float, uint32_t>& lhs, const std::pair<float, uint32_t>& rhs) {
+                return lhs.first > rhs.first || (lhs.first == rhs.first && lhs.second < rhs.second);
+            };
+            std::sort(left_gains.begin(), left_gains.end(), by_gain);
+            std::sort(right_gains.begin(), right_gains.end(), by_gain);
+
+            size_t swaps = 0;
+            for (; swaps < std::min(left_gains.size(), right_gains.size())
+                   && left_gains[swaps].first + right_gains[swaps].first > 0; ++swaps) {
+                ForEachTerm(left_gains[swaps].second, [this](uint32_t term) {
+                    --left_degrees[term];
+                    ++right_degrees[term];
+                });
+                ForEachTerm(right_gains[swaps].second, [this](uint32_t term) {
+                    ++left_degrees[term];
+                    --right_degrees[term];
+                });
+                std::swap(left_gains[swaps].second, right_gains[swaps].second);
+            }
+            if (swaps == 0) {
+                break;
+            }
+            for (size_t i = 0; i < left_gains.size(); ++i) {
+                begin[i] = left_gains[i].second;
+            }
+            for (size_t i = 0; i < right_gains.size(); ++i) {
+                middle[i] = right_gains[i].second;
+            }
+        }
+
+        for (const uint32_t* doc = begin; doc != end; ++doc) {
+            ForEachTerm(*doc, [this](uint32_t term) {
+                left_degrees[term] = 0;
+                right_degrees[term] = 0;
+            });
+        }
+        Split(begin, middle);
+        Split(middle, end);
+    }
+
+private:
+    template<typename Callback>
+    void ForEachTerm(uint32_t doc, Callback callback) const {
+        for (size_t i = starts[doc]; i < starts[doc + 1]; ++i) {
+            callback(terms[i]);
+        }
+    }
+
+    // estimated bits of the gaps of a list with `degree` of 2^log_size documents
+    float Cost(uint32_t degree, float log_size) const {
+        return degree * (log_size - log2s[degree + 1]);
+    }
+
+    const std::vector<uint32_t>& terms;
+    const std::vector<size_t>& starts;
+    // documents of the left and the right half containing each term
+    std::vector<uint32_t> left_degrees;
+    std::vector<uint32_t> right_degrees;
+    std::vector<float> log2s;
+    std::vector<std::pair<float, uint32_t>> left_gains;
+    std::vector<std::pair<float, uint32_t>> right_gains;
+};
+
+}  // namespace
+
+std::vector<uint32_t> BisectionOrder(const std::vector<uint32_t>& terms, const std::vector<size_t>& starts,
+                                     size_t terms_num) {
+    std::vector<uint32_t> order(starts.size() - 1);
+    std::iota(order.begin(), order.end(), 0);
+    Bisection(terms, starts, terms_num).Split(order.data(), order.data() + order.size());
+    return order;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Docid order that puts documents sharing terms next to each other, found by
+// recursive graph bisection: the documents are split into halves, pairs of
+// documents swap halves while that shrinks the estimated log2 gaps of the
+// posting lists, and each half is split the same way.
+//
+// `terms` holds the distinct term ids (below `terms_num`) of every document:
+// those of docid d are terms[starts[d]] .. terms[starts[d + 1] - 1].
+// Returns the old docid of every new docid. The order is deterministic.
+std::vector<uint32_t> BisectionOrder(const std::vector<uint32_t>& terms, const std::vector<size_t>& starts,
+                                     size_t terms_num);
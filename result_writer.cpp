@@ -0,0 +1,43 @@
+#include "result_writer.h"
+
+#include <charconv>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+void ResultWriter::Write(std::string_view query, const std::vector<Item>& top_docs) {
+    if (format == ResultFormat::BINARY) {
+        AppendUint32(top_docs.size());
+        for (auto [docid, hitcount] : top_docs) {
+            AppendUint32(docid);
+            AppendUint32(hitcount);
+        }
+        return;
+    }
+
+    buffer.append(query);
+    buffer.push_back(':');
+    for (auto [docid, hitcount] : top_docs) {
+        buffer.append(" {docid: ");
+        AppendNumber(docid);
+        buffer.append(", hitcount: ");
+        AppendNumber(hitcount);
+        buffer.push_back('}');
+    }
+    buffer.push_back('\n');
+}
+
+void ResultWriter::AppendNumber(size_t value) {
+    char digits[20];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer.append(digits, result.ptr);
+}
+
+void ResultWriter::AppendUint32(size_t value) {
+    if (value > std::numeric_limits<uint32_t>::max()) {
+        throw std::overflow_error("ResultWriter: " + std::to_string(value) + " does not fit in a binary answer");
+    }
+    for (int byte = 0; byte < 4; ++byte) {
+        buffer.push_back(static_cast<char>(value >> (8 * byte)));
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "postings.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class ResultFormat {
+    // "query: {docid: 1, hitcount: 2} {docid: 0, hitcount: 1}\n" per query
+    TEXT,
+    // per query: uint32 number of results, then uint32 docid and uint32
+    // hitcount for each of them; all little endian, the query text is omitted.
+    // Write() throws std::overflow_error for a value that does not fit.
+    BINARY,
+};
+
+// Formats answers of queries into a byte buffer that is reused between
+// batches, so a worker writes a whole chunk of answers with one call.
+class ResultWriter {
+public:
+    explicit ResultWriter(ResultFormat format = ResultFormat::TEXT) :
+            format(format)
+    {
+    }
+
+    void Write(std::string_view query, const std::vector<Item>& top_docs);
+
+    std::string_view Data() const {
+        return buffer;
+    }
+
+    // starts a new batch, keeping the buffer capacity
+    void Reset(ResultFormat format) {
+        this->format = format;
+        buffer.clear();
+    }
+
+private:
+    void AppendNumber(size_t value);
+
+    // throws std::overflow_error if `value` does not fit in 32 bits
+    void AppendUint32(size_t value);
+
+    ResultFormat format;
+    std::string buffer;
+};
@@ -0,0 +1,27 @@
+#include "scoring.h"
+
+#include <algorithm>
+
+void HitAccumulator::Reset(size_t docs_num) {
+    if (counts.size() < docs_num) {
+        // fresh slots get stamp 0, which never matches a live stamp
+        counts.resize(docs_num);
+        stamps.resize(docs_num, 0);
+    }
+    if (++stamp == 0) {
+        // stamp wrapped around: stale slots could look valid again
+        std::fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+    touched.clear();
+}
+
+std::vector<Item> SelectTopDocs(const HitAccumulator& accumulator, size_t max_docs, DocidMap original_docids) {
+    auto get_hits = [&accumulator](size_t docid) {
+        return accumulator.Hits(docid);
+    };
+    if (original_docids.docids == nullptr) {
+        return SelectTop(accumulator.Touched(), get_hits, max_docs);
+    }
+    return SelectTop(accumulator.Touched(), get_hits, max_docs, BetterHit(), original_docids);
+}
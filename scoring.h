@@ -0,0 +1,193 @@
+#pragma once
+
+#include "postings.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Per-query hit counters that only pay for the documents a query touches.
+// Slots are validated by a stamp instead of being zeroed, so Reset() is O(1)
+// and the storage is reused from query to query.
+class HitAccumulator {
+public:
+    void Reset(size_t docs_num);
+
+    void Add(size_t docid, size_t hits) {
+        if (stamps[docid] != stamp) {
+            stamps[docid] = stamp;
+            counts[docid] = 0;
+            touched.push_back(docid);
+        }
+        counts[docid] += hits;
+    }
+
+    size_t Hits(size_t docid) const {
+        return stamps[docid] == stamp ? counts[docid] : 0;
+    }
+
+    const std::vector<size_t>& Touched() const {
+        return touched;
+    }
+
+    size_t MemoryBytes() const {
+        return counts.capacity() * sizeof(size_t) + stamps.capacity() * sizeof(uint32_t)
+               + touched.capacity() * sizeof(size_t);
+    }
+
+private:
+    std::vector<size_t> counts;
+    std::vector<uint32_t> stamps;
+    std::vector<size_t> touched;
+    uint32_t stamp = 0;
+};
+
+// Best documents first: more hits wins, equal hits go to the smaller docid.
+inline bool IsBetterHit(const Item& lhs, const Item& rhs) {
+    return lhs.hits > rhs.hits || (lhs.hits == rhs.hits && lhs.docid < rhs.docid);
+}
+
+// IsBetterHit as a function object. The selectors below take any order that
+// ranks more hits first like it, e.g. one that also counts its calls; they
+// reject candidates with fewer hits than the worst entry without calling it.
+struct BetterHit {
+    bool operator()(const Item& lhs, const Item& rhs) const {
+        return IsBetterHit(lhs, rhs);
+    }
+};
+
+// Best K of a stream of candidates with hits > 0, kept sorted best first in a
+// fixed array prefilled with entries of 0 hits that every candidate beats.
+// A candidate that does not enter costs one comparison with the last entry.
+// One that does finds its place by comparing with all entries, a sum of
+// flags without data-dependent branches, and the worse entries shift down.
+template<size_t K, typename Better = BetterHit>
+class FixedTopK {
+public:
+    static_assert(K > 0);
+
+    explicit FixedTopK(Better better = {}) :
+            better(better)
+    {
+        top.fill({SIZE_MAX, 0});
+    }
+
+    void Offer(const Item& candidate) {
+        // most candidates have fewer hits than the last entry: one well predicted branch
+        if (candidate.hits < top[K - 1].hits || !better(candidate, top[K - 1])) {
+            return;
+        }
+        size_t position = 0;
+        for (size_t i = 0; i + 1 < K; ++i) {
+            position += better(top[i], candidate);
+        }
+        std::copy_backward(top.begin() + position, top.end() - 1, top.end());
+        top[position] = candidate;
+        filled += filled < K;
+    }
+
+    void AppendTo(std::vector<Item>& out) const {
+        out.insert(out.end(), top.begin(), top.begin() + filled);
+    }
+
+private:
+    std::array<Item, K> top;
+    size_t filled = 0;
+    Better better;
+};
+
+// Best `max_docs` of a stream for any max_docs > 0, in a heap whose front is
+// the worst entry.
+template<typename Better = BetterHit>
+class HeapTopK {
+public:
+    explicit HeapTopK(size_t max_docs, Better better = {}) :
+            max_docs(max_docs),
+            better(better)
+    {
+        top.reserve(max_docs);
+    }
+
+    void Offer(const Item& candidate) {
+        if (top.size() < max_docs) {
+            top.push_back(candidate);
+            std::push_heap(top.begin(), top.end(), better);
+        } else if (candidate.hits >= top.front().hits && better(candidate, top.front())) {
+            std::pop_heap(top.begin(), top.end(), better);
+            top.back() = candidate;
+            std::push_heap(top.begin(), top.end(), better);
+        }
+    }
+
+    void AppendTo(std::vector<Item>& out) {
+        std::sort_heap(top.begin(), top.end(), better);
+        out.insert(out.end(), top.begin(), top.end());
+    }
+
+private:
+    std::vector<Item> top;
+    size_t max_docs;
+    Better better;
+};
+
+// Docids of a reordered base (see IndexBuildOptions::reorder_documents) as
+// the documents were numbered on input: docids below `size` are looked up in
+// `docids`, later ones are their own. Without a table every docid is its own.
+struct DocidMap {
+    const uint32_t* docids = nullptr;
+    size_t size = 0;
+
+    size_t operator()(size_t docid) const {
+        return docid < size ? docids[docid] : docid;
+    }
+};
+
+struct SameDocid {
+    size_t operator()(size_t docid) const {
+        return docid;
+    }
+};
+
+// Offers {map_docid(docid), hits} for every docid with hits: selection and
+// its tie-breaking see the mapped docids.
+template<typename Selector, typename GetHits, typename MapDocid = SameDocid>
+std::vector<Item> SelectTopWith(Selector selector, const std::vector<size_t>& docids, GetHits get_hits,
+                                MapDocid map_docid = {}) {
+    for (size_t docid : docids) {
+        const size_t hits = get_hits(docid);
+        if (hits != 0) {
+            selector.Offer({map_docid(docid), hits});
+        }
+    }
+    std::vector<Item> top;
+    selector.AppendTo(top);
+    return top;
+}
+
+// Top `max_docs` of `docids` with get_hits(docid) hits, in `better` order.
+// The usual depths 1, 5, 10 and 20 have FixedTopK kernels, others use the heap.
+template<typename GetHits, typename Better = BetterHit, typename MapDocid = SameDocid>
+std::vector<Item> SelectTop(const std::vector<size_t>& docids, GetHits get_hits, size_t max_docs,
+                            Better better = {}, MapDocid map_docid = {}) {
+    switch (max_docs) {
+    case 0:
+        return {};
+    case 1:
+        return SelectTopWith(FixedTopK<1, Better>(better), docids, get_hits, map_docid);
+    case 5:
+        return SelectTopWith(FixedTopK<5, Better>(better), docids, get_hits, map_docid);
+    case 10:
+        return SelectTopWith(FixedTopK<10, Better>(better), docids, get_hits, map_docid);
+    case 20:
+        return SelectTopWith(FixedTopK<20, Better>(better), docids, get_hits, map_docid);
+    default:
+        return SelectTopWith(HeapTopK<Better>(max_docs, better), docids, get_hits, map_docid);
+    }
+}
+
+// Top `max_docs` touched documents in IsBetterHit order, see SelectTop.
+// The answer carries, and ties are broken on, the docids of `original_docids`.
+std::vector<Item> SelectTopDocs(const HitAccumulator& accumulator, size_t max_docs,
+                                DocidMap original_docids = {});
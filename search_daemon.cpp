@@ -0,0 +1,53 @@
+#include "daemon.h"
+#include "search_server.h"
+
+#include <csignal>
+#include <exception>
+#include <fstream>
+#include <iostream>
+
+namespace {
+
+SearchDaemon* running_daemon = nullptr;
+
+void StopOnSignal(int) {
+    running_daemon->Stop();
+}
+
+}  // namespace
+
+// SearchEngineDaemon <socket path> [documents file]: keeps one index warm and
+// answers the clients connecting to the socket, see daemon.h for the protocol.
+// SIGINT and SIGTERM stop it and remove the socket file.
+int main(int argc, char* argv[]) {
+    if (argc < 2 || argc > 3) {
+        std::cerr << "usage: " << argv[0] << " <socket path> [documents file]" << std::endl;
+        return 2;
+    }
+
+    try {
+        SearchServer server;
+        if (argc == 3) {
+            std::ifstream document_input(argv[2]);
+            if (!document_input) {
+                std::cerr << "cannot open " << argv[2] << std::endl;
+                return 1;
+            }
+            server.UpdateDocumentBase(document_input);
+        }
+
+        SearchDaemon daemon(server, argv[1]);
+        running_daemon = &daemon;
+        struct sigaction action = {};
+        action.sa_handler = StopOnSignal;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+
+        std::cerr << "listening on " << argv[1] << std::endl;
+        daemon.Run();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
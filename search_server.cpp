@@ -1,142 +1,505 @@
-#include "profile.h"
-
-#include "search_server.h"
-#include "iterator_range.h"
-#include "parse.h"
-
-#include <algorithm>
-#include <numeric>
-#include <functional>
-
-InvertedIndex::InvertedIndex(std::istream& document_input) {
-    for (std::string current_document; getline(document_input, current_document); ) {
-        Add(std::move(current_document));
-    }
-}
-
-void InvertedIndex::Add(std::string&& document) {
-    docs.push_back(std::move(document));
-
-    const size_t docid = docs.size() - 1;
-
-    std::map<std::string_view, size_t> words_to_hits;
-    for (std::string_view word : SplitIntoWordsView(docs.back())) {
-        ++words_to_hits[word];
-    }
-
-    for(const auto& [word, hits] : words_to_hits) {
-        index[word].push_back({docid, hits});
-    }
-}
-
-const std::vector<Item>& InvertedIndex::Lookup(std::string_view word) const {
-    static const std::vector<Item> empty = {};
-
-    if (auto it = index.find(word); it != index.end()) {
-        return it->second;
-    } else {
-        return empty;
-    }
-}
-
-SearchServer::SearchServer(std::istream& document_input) {
-    UpdateDocumentBase(document_input);
-}
-
-void UpdateDocumentBaseSingleThread(std::istream& document_input, Synchronized<InvertedIndex>& sync_index) {
-    InvertedIndex new_index(document_input);
-
-    auto access = sync_index.GetAccess();
-    auto& index = access.ref_to_value;
-    index = std::move(new_index);
-}
-
-void SearchServer::UpdateDocumentBase(std::istream& document_input) {
-    futures.push_back(async(UpdateDocumentBaseSingleThread, ref(document_input), std::ref(sync_index)));
-
-    if (firstUpdate) {
-        firstUpdate = false;
-        futures.back().get();
-        futures.pop_back();
-    }
-}
-
-void AddQueriesStreamSingleThread(
-        std::istream& query_input, std::ostream& search_results_output, Synchronized<InvertedIndex>& sync_index) {
-
-    // duration tests
-    TotalDuration lookup("search_server.cpp: Total lookup in an inverted index");
-    TotalDuration sort("search_server.cpp: Total sorting of hits");
-    TotalDuration response("search_server.cpp: Total forming a response");
-
-    const unsigned MAX_REL_DOCS_NUM = 5;
-
-    std::vector<size_t> doc_counts;
-    std::vector<size_t> docids;
-
-    for (std::string current_query; getline(query_input, current_query); ) {
-
-        const size_t DOCS_NUM = sync_index.GetAccess().ref_to_value.GetDocsSize();
-
-        doc_counts.assign(DOCS_NUM, 0);
-        docids.resize(DOCS_NUM);
-        iota(docids.begin(), docids.end(), 0);
-
-        std::vector<std::string_view> words = SplitIntoWordsView(current_query);
-
-        {
-            // area under mutex
-            auto access = sync_index.GetAccess();
-            auto& index = access.ref_to_value;
-            {
-                for (auto word : words) {
-                    ADD_DURATION(lookup);
-                    for (auto [docid, hits] : index.Lookup(word)) {
-                        doc_counts[docid] += hits;
-                    }
-                }
-            }
-        }
-
-        {
-            ADD_DURATION(sort);
-            std::partial_sort(docids.begin(),
-                         Head(docids, MAX_REL_DOCS_NUM).end(), // if docids.size() < 5 Head will return full range
-                         docids.end(),
-                         [&doc_counts](size_t lhs, size_t rhs) {
-                             return std::make_pair(doc_counts[lhs], rhs) // !!! size_t is unsigned
-                                    > std::make_pair(doc_counts[rhs], lhs);
-                         });
-        }
-
-        {
-            ADD_DURATION(response);
-            search_results_output << current_query << ':';
-            for (auto docid : Head(docids, MAX_REL_DOCS_NUM)) {
-                if (doc_counts[docid] == 0) break;
-                search_results_output << " {"
-                                      << "docid: " << docid << ", "
-                                      << "hitcount: " << doc_counts[docid] << '}';
-            }
-            search_results_output << '\n';
-        }
-    }
-}
-
-void SearchServer::AddQueriesStream(
-        std::istream& query_input, std::ostream& search_results_output) {
-
-    futures.push_back(async(AddQueriesStreamSingleThread,
-                      std::ref(query_input),
-                      std::ref(search_results_output),
-                      std::ref(sync_index))
-                      );
-}
-
-void SearchServer::Synchronize() {
-    for (auto& future: futures) {
-        future.get();
-    }
-
-    futures.clear();
-}
+#include "search_server.h"
+#include "iterator_range.h"
+#include "parse.h"
+#include "scoring.h"
+#include "maxscore.h"
+#include "result_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <numeric>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <exception>
+#include <stdexcept>
+
+using std::chrono::steady_clock;
+
+SearchServer::SearchServer(const SearchServerOptions& options) :
+        options(options),
+        query_cache(options.query_cache_capacity),
+        executor(options.threads)
+{
+}
+
+SearchServer::SearchServer(std::istream& document_input, const SearchServerOptions& options) :
+        SearchServer(options)
+{
+    UpdateDocumentBase(document_input);
+}
+
+void UpdateDocumentBaseSingleThread(std::istream& document_input,
+                                    Versioned<SegmentedIndex>& index_versions,
+                                    const IndexBuildOptions& build_options, Metrics& metrics) {
+    const auto build_start = steady_clock::now();
+    InvertedIndex index(document_input, build_options);
+    metrics.Record(Phase::INDEX_BUILD, steady_clock::now() - build_start);
+    index_versions.Publish(SegmentedIndex(std::move(index)));
+}
+
+void SearchServer::UpdateDocumentBase(std::istream& document_input) {
+    if (firstUpdate) {
+        firstUpdate = false;
+        UpdateDocumentBaseSingleThread(document_input, index_versions, BuildOptionsWithinBudget(), metrics);
+        return;
+    }
+
+    executor.Submit([this, &document_input] {
+        UpdateDocumentBaseSingleThread(document_input, index_versions, BuildOptionsWithinBudget(), metrics);
+    });
+}
+
+std::string ServerMemoryUsage::ToJson() const {
+    std::ostringstream json;
+    json << "{\"dictionary\": " << index.dictionary << ", \"postings\": " << index.postings
+         << ", \"documents\": " << index.documents << ", \"mapped\": " << index.mapped
+         << ", \"query_scratch\": " << query_scratch << ", \"query_cache\": " << query_cache
+         << ", \"total\": " << Total() << '}';
+    return json.str();
+}
+
+ServerMemoryUsage SearchServer::GetMemoryUsage() const {
+    ServerMemoryUsage usage;
+    usage.index = index_versions.Acquire()->value.GetMemoryUsage();
+    usage.query_scratch = metrics.Read().Get(Gauge::QUERY_SCRATCH_BYTES);
+    usage.query_cache = query_cache.MemoryBytes();
+    return usage;
+}
+
+IndexBuildOptions SearchServer::BuildOptionsWithinBudget() const {
+    IndexBuildOptions build_options = options.index_build;
+    if (options.memory_budget == 0) {
+        return build_options;
+    }
+    const size_t used = GetMemoryUsage().Total();
+    if (used >= options.memory_budget) {
+        throw std::runtime_error("SearchServer: memory budget of " + std::to_string(options.memory_budget)
+                                 + " bytes is used up");
+    }
+    const size_t left = options.memory_budget - used;
+    build_options.memory_limit = build_options.memory_limit == 0 ? left : std::min(build_options.memory_limit, left);
+    return build_options;
+}
+
+namespace {
+
+// State shared by the tasks answering one query stream
+struct QueryStream {
+    explicit QueryStream(std::ostream& output) :
+            output(output)
+    {
+    }
+
+    std::ostream& output;
+    std::atomic<size_t> chunks_in_flight = 0;  // handed to the workers, not answered yet
+
+    std::mutex m;
+    size_t next_chunk = 0;
+    std::map<size_t, std::string> answered_chunks;  // waiting for the chunks before them
+};
+
+// Writes `answers` right away when all chunks before it are out; otherwise
+// keeps a copy until they are.
+void WriteInOrder(QueryStream& stream, size_t chunk_index, std::string_view answers, Metrics& metrics) {
+    const auto wait_start = steady_clock::now();
+    std::lock_guard<std::mutex> guard(stream.m);
+    metrics.Record(Phase::LOCK_WAIT, steady_clock::now() - wait_start);
+    if (chunk_index != stream.next_chunk) {
+        stream.answered_chunks.emplace(chunk_index, answers);
+        return;
+    }
+    stream.output.write(answers.data(), answers.size());
+    ++stream.next_chunk;
+
+    auto it = stream.answered_chunks.begin();
+    for (; it != stream.answered_chunks.end() && it->first == stream.next_chunk; ++it) {
+        stream.output.write(it->second.data(), it->second.size());
+        ++stream.next_chunk;
+    }
+    stream.answered_chunks.erase(stream.answered_chunks.begin(), it);
+}
+
+// Scratch of the threads answering queries, reused by all their queries.
+struct QueryScratch {
+    HitAccumulator doc_counts;
+    // not doc_counts: the worker scoring a query on ranges scores one of them too
+    HitAccumulator shard_counts;
+    // words of the queries of a chunk
+    std::vector<std::vector<std::string_view>> words;
+
+    size_t MemoryBytes() const {
+        size_t bytes = doc_counts.MemoryBytes() + shard_counts.MemoryBytes() + words.capacity() * sizeof(words[0]);
+        for (const auto& query_words : words) {
+            bytes += query_words.capacity() * sizeof(std::string_view);
+        }
+        return bytes;
+    }
+};
+
+QueryScratch& LocalScratch() {
+    thread_local QueryScratch scratch;
+    return scratch;
+}
+
+// what() of the exception, for the callbacks that report failures as text
+std::string ErrorMessage(std::exception_ptr error) {
+    try {
+        std::rethrow_exception(error);
+    } catch (const std::exception& e) {
+        return e.what();
+    } catch (...) {
+        return "unknown error";
+    }
+}
+
+// Puts one "error: <reason>" line per query in the place of a chunk that
+// failed, so the answers after it still come out and line up with their queries.
+void WriteChunkErrors(QueryStream& stream, size_t chunk_index, size_t queries_num, std::exception_ptr error,
+                      Metrics& metrics) {
+    const std::string line = "error: " + ErrorMessage(error) + "\n";
+    std::string errors;
+    for (size_t i = 0; i < queries_num; ++i) {
+        errors += line;
+    }
+    WriteInOrder(stream, chunk_index, errors, metrics);
+}
+
+}  // namespace
+
+// Top documents of one query, scored on `shards` docid ranges of the base in
+// parallel. A document belongs to one range only, so the best `max_docs` of
+// the range tops are the top of the whole base.
+std::vector<Item> AnswerQuerySharded(const SegmentedIndex& index, const std::vector<std::string_view>& words,
+                                     size_t max_docs, size_t shards, Executor& executor, Metrics& metrics) {
+    const size_t docs_num = index.GetDocsSize();
+    std::vector<std::vector<Item>> shard_top_docs(shards);
+    executor.ParallelFor(shards, [&](size_t shard) {
+        QueryScratch& scratch = LocalScratch();
+        HitAccumulator& shard_counts = scratch.shard_counts;
+        shard_counts.Reset(docs_num);
+        for (auto word : words) {
+            index.AddHits(word, docs_num * shard / shards, docs_num * (shard + 1) / shards, shard_counts);
+        }
+        shard_top_docs[shard] = SelectTopDocs(shard_counts, max_docs, index.OriginalDocids());
+        metrics.Set(Gauge::QUERY_SCRATCH_BYTES, scratch.MemoryBytes());
+    });
+
+    std::vector<Item> top_docs;
+    for (const auto& shard_top : shard_top_docs) {
+        top_docs.insert(top_docs.end(), shard_top.begin(), shard_top.end());
+    }
+    const auto middle = top_docs.begin() + std::min(top_docs.size(), max_docs);
+    std::partial_sort(top_docs.begin(), middle, top_docs.end(), IsBetterHit);
+    top_docs.erase(middle, top_docs.end());
+    return top_docs;
+}
+
+void AnswerQueryChunk(const std::vector<std::string>& queries, size_t chunk_index, QueryStream& stream,
+                      const Versioned<SegmentedIndex>& index_versions, QueryCache& query_cache,
+                      const SearchServerOptions& options, Executor& executor, Metrics& metrics) {
+
+    QueryScratch& scratch = LocalScratch();
+    HitAccumulator& doc_counts = scratch.doc_counts;
+
+    // all queries of the chunk are answered from one generation of the index
+    const auto snapshot = index_versions.Acquire();
+    const SegmentedIndex& index = snapshot->value;
+
+    // reused between chunks, so splitting a query allocates nothing in steady state
+    auto& words = scratch.words;
+    if (words.size() < queries.size()) {
+        words.resize(queries.size());
+    }
+    std::vector<std::string> cache_keys(queries.size());
+    std::vector<std::vector<Item>> top_docs(queries.size());
+
+    metrics.Add(Counter::QUERIES, queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto query_start = steady_clock::now();
+        words[i].clear();
+        ForEachWord(queries[i], [&query_words = words[i]](std::string_view word) {
+            query_words.push_back(word);
+        });
+        cache_keys[i] = QueryCache::MakeKey(words[i]);
+        if (query_cache.Find(cache_keys[i], snapshot->generation, top_docs[i])) {
+            metrics.Add(Counter::QUERY_CACHE_HITS);
+            metrics.Record(Phase::QUERY, steady_clock::now() - query_start);
+            continue;
+        }
+
+        if (options.query_shards > 1) {
+            {
+                // scoring and selection run together on the ranges, both count as lookup
+                RECORD_DURATION(metrics, Phase::LOOKUP);
+                top_docs[i] = AnswerQuerySharded(index, words[i], options.max_results, options.query_shards, executor,
+                                                 metrics);
+            }
+            query_cache.Insert(cache_keys[i], snapshot->generation, top_docs[i]);
+            metrics.Record(Phase::QUERY, steady_clock::now() - query_start);
+        } else if (options.prune_queries && !index.OriginalDocids().docids) {
+            // MaxScore breaks ties on the docids of the base, a reordered one is scored exhaustively
+            {
+                // traversal and selection are interleaved, both count as lookup
+                RECORD_DURATION(metrics, Phase::LOOKUP);
+                top_docs[i] = SelectTopDocsMaxScore(index, words[i], options.max_results);
+            }
+            query_cache.Insert(cache_keys[i], snapshot->generation, top_docs[i]);
+            metrics.Record(Phase::QUERY, steady_clock::now() - query_start);
+        } else {
+            doc_counts.Reset(index.GetDocsSize());
+
+            {
+                RECORD_DURATION(metrics, Phase::LOOKUP);
+                for (auto word : words[i]) {
+                    index.AddHits(word, doc_counts);
+                }
+            }
+
+            {
+                RECORD_DURATION(metrics, Phase::TOP_K);
+                top_docs[i] = SelectTopDocs(doc_counts, options.max_results, index.OriginalDocids());
+            }
+            query_cache.Insert(cache_keys[i], snapshot->generation, top_docs[i]);
+            metrics.Record(Phase::QUERY, steady_clock::now() - query_start);
+        }
+    }
+    metrics.Set(Gauge::QUERY_SCRATCH_BYTES, scratch.MemoryBytes());
+
+    thread_local ResultWriter writer;
+    {
+        RECORD_DURATION(metrics, Phase::FORMATTING);
+        writer.Reset(options.result_format);
+        for (size_t i = 0; i < queries.size(); ++i) {
+            writer.Write(queries[i], top_docs[i]);
+        }
+    }
+
+    WriteInOrder(stream, chunk_index, writer.Data(), metrics);
+}
+
+void SearchServer::LoadDocumentBase(const std::string& index_path) {
+    index_versions.Publish(SegmentedIndex(InvertedIndex::Map(index_path, options.verify_index_files)));
+}
+
+size_t SearchServer::AddSegment(InvertedIndex segment) {
+    metrics.Add(Counter::DOCUMENTS_ADDED, segment.GetDocsSize());
+    size_t first_docid = 0;
+    index_versions.Update([&](const SegmentedIndex& current) {
+        first_docid = current.GetDocsSize();
+        return current.Append(std::move(segment));
+    });
+    ScheduleMerges();
+    return first_docid;
+}
+
+size_t SearchServer::AddDocument(std::string document) {
+    InvertedIndex segment;
+    {
+        RECORD_DURATION(metrics, Phase::INDEX_BUILD);
+        segment.Add(std::move(document));
+        if (options.index_build.compress_postings) {
+            segment.Compress();
+        } else {
+            segment.Freeze();
+        }
+    }
+    return AddSegment(std::move(segment));
+}
+
+size_t SearchServer::AddDocuments(std::istream& document_input) {
+    const auto build_start = steady_clock::now();
+    InvertedIndex segment(document_input, BuildOptionsWithinBudget());
+    metrics.Record(Phase::INDEX_BUILD, steady_clock::now() - build_start);
+    return AddSegment(std::move(segment));
+}
+
+void SearchServer::RemoveDocument(size_t docid) {
+    metrics.Add(Counter::DOCUMENTS_REMOVED);
+    index_versions.Update([docid](const SegmentedIndex& current) {
+        return current.Delete(docid);
+    });
+}
+
+void SearchServer::ScheduleMerges() {
+    if (!index_versions.Acquire()->value.PickMerge(options.segment_merge_factor)) {
+        return;
+    }
+    // one merge task at a time; it keeps going while the policy finds work
+    if (!merge_running.exchange(true)) {
+        executor.Submit([this] { MergeSegments(); });
+    }
+}
+
+void SearchServer::MergeSegments() {
+    while (true) {
+        // generation of the base on which the policy found nothing more to do
+        const uint64_t stopped_generation = MergeWhileWork();
+        merge_running = false;
+
+        // an AddSegment in the meantime saw the flag still set and left its
+        // merge to this task: take the flag back if the base has changed since
+        const auto latest = index_versions.Acquire();
+        if (latest->generation == stopped_generation || !latest->value.PickMerge(options.segment_merge_factor)
+            || merge_running.exchange(true)) {
+            return;
+        }
+    }
+}
+
+uint64_t SearchServer::MergeWhileWork() {
+    while (true) {
+        const auto snapshot = index_versions.Acquire();
+        const SegmentedIndex& source = snapshot->value;
+        const auto range = source.PickMerge(options.segment_merge_factor);
+        if (!range) {
+            return snapshot->generation;
+        }
+        if (options.memory_budget != 0) {
+            // the merged segment takes about as much as its parts until they are released
+            size_t merged_bytes = 0;
+            for (size_t i = range->first; i < range->second; ++i) {
+                merged_bytes += source.GetSegments()[i].index->GetMemoryUsage().Total();
+            }
+            if (GetMemoryUsage().Total() + merged_bytes > options.memory_budget) {
+                metrics.Add(Counter::SEGMENT_MERGES_DEFERRED);
+                return snapshot->generation;
+            }
+        }
+
+        const auto build_start = steady_clock::now();
+        InvertedIndex merged = source.MergeSegments(range->first, range->second, options.index_build);
+        metrics.Record(Phase::INDEX_BUILD, steady_clock::now() - build_start);
+        metrics.Add(Counter::SEGMENT_MERGES);
+
+        // if the base was replaced meanwhile the merge is dropped and the
+        // policy is asked again about the new base
+        index_versions.TryUpdate([&](const SegmentedIndex& current) {
+            return current.Replace(source, range->first, range->second, std::move(merged));
+        });
+    }
+}
+
+void SearchServer::AddQueriesStream(
+        std::istream& query_input, std::ostream& search_results_output) {
+
+    auto stream = std::make_shared<QueryStream>(search_results_output);
+
+    // one task reads the stream and hands out chunks of it to the workers
+    executor.Submit([this, &query_input, stream] {
+        const size_t max_in_flight = options.query_chunks_in_flight != 0
+            ? options.query_chunks_in_flight
+            : 2 * executor.Size();
+        size_t chunk_index = 0;
+        std::vector<std::string> chunk;
+        // the first failure of a chunk answered here, rethrown once the stream is read
+        std::exception_ptr error;
+
+        auto submit_chunk = [&] {
+            if (stream->chunks_in_flight.load() >= max_in_flight) {
+                // waiting for the workers instead could block them all when
+                // every one of them is a reader
+                try {
+                    AnswerQueryChunk(chunk, chunk_index, *stream, index_versions, query_cache, options, executor,
+                                     metrics);
+                } catch (...) {
+                    WriteChunkErrors(*stream, chunk_index, chunk.size(), std::current_exception(), metrics);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                }
+            } else {
+                ++stream->chunks_in_flight;
+                executor.Submit([this, stream, chunk_index, queries = std::move(chunk)] {
+                    try {
+                        AnswerQueryChunk(queries, chunk_index, *stream, index_versions, query_cache, options,
+                                         executor, metrics);
+                    } catch (...) {
+                        WriteChunkErrors(*stream, chunk_index, queries.size(), std::current_exception(), metrics);
+                        --stream->chunks_in_flight;
+                        throw;
+                    }
+                    --stream->chunks_in_flight;
+                });
+            }
+            ++chunk_index;
+            chunk.clear();
+        };
+
+        for (std::string current_query; getline(query_input, current_query); ) {
+            chunk.push_back(std::move(current_query));
+            if (chunk.size() >= options.query_chunk_lines) {
+                submit_chunk();
+            }
+        }
+        if (!chunk.empty()) {
+            submit_chunk();
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    });
+}
+
+void SearchServer::AnswerQueries(std::vector<std::string> queries, std::function<void(std::string)> done) {
+    const size_t chunk_lines = std::max<size_t>(options.query_chunk_lines, 1);
+    const size_t chunks_num = (queries.size() + chunk_lines - 1) / chunk_lines;
+    if (chunks_num == 0) {
+        done({});
+        return;
+    }
+
+    // chunks are put in order by the same QueryStream as AddQueriesStream's
+    struct Request {
+        std::ostringstream output;
+        QueryStream stream{output};
+        std::atomic<size_t> chunks_left;
+        std::function<void(std::string)> done;
+    };
+    auto request = std::make_shared<Request>();
+    request->chunks_left = chunks_num;
+    request->done = std::move(done);
+
+    for (size_t chunk_index = 0; chunk_index < chunks_num; ++chunk_index) {
+        const size_t first = chunk_index * chunk_lines;
+        const size_t last = std::min(first + chunk_lines, queries.size());
+        std::vector<std::string> chunk(std::make_move_iterator(queries.begin() + first),
+                                       std::make_move_iterator(queries.begin() + last));
+        executor.Submit([this, request, chunk_index, chunk = std::move(chunk)] {
+            try {
+                AnswerQueryChunk(chunk, chunk_index, request->stream, index_versions, query_cache, options, executor,
+                                 metrics);
+            } catch (...) {
+                // the chunk still takes its place in the answers, or the request would never complete
+                WriteChunkErrors(request->stream, chunk_index, chunk.size(), std::current_exception(), metrics);
+            }
+            if (--request->chunks_left == 0) {
+                request->done(std::move(request->output).str());
+            }
+        });
+    }
+}
+
+void SearchServer::UpdateDocumentBase(const std::string& path, std::function<void(std::string)> done) {
+    executor.Submit([this, path, done = std::move(done)] {
+        std::ifstream document_input(path);
+        if (!document_input) {
+            done("cannot open " + path);
+            return;
+        }
+        try {
+            UpdateDocumentBaseSingleThread(document_input, index_versions, BuildOptionsWithinBudget(), metrics);
+        } catch (...) {
+            done(ErrorMessage(std::current_exception()));
+            return;
+        }
+        done({});
+    });
+}
+
+void SearchServer::Synchronize() {
+    executor.WaitIdle();
+}
@@ -1,59 +1,152 @@
-#pragma once
-
-#include "synchronized.h"
-
-#include <istream>
-#include <ostream>
-#include <vector>
-#include <map>
-#include <unordered_map>
-#include <string>
-#include <string_view>
-#include <deque>
-#include <future>
-
-struct Item {
-    size_t docid;
-    size_t hits;
-};
-
-class InvertedIndex {
-public:
-    InvertedIndex() = default;
-
-    explicit InvertedIndex(std::istream& document_input);
-
-    void Add(std::string&& document);
-
-    const std::vector<Item>& Lookup(std::string_view word) const;
-
-    const std::string& GetDocument(size_t docid) const {
-        return docs[docid];
-    }
-
-    size_t GetDocsSize() const {
-        return docs.size();
-    }
-
-private:
-    std::map<std::string_view, std::vector<Item>> index;
-    std::deque<std::string> docs;
-};
-
-class SearchServer {
-public:
-    SearchServer() = default;
-
-    explicit SearchServer(std::istream& document_input);
-
-    void UpdateDocumentBase(std::istream& document_input);
-
-    void AddQueriesStream(std::istream& query_input, std::ostream& search_results_output);
-
-    void Synchronize();
-private:
-    Synchronized<InvertedIndex> sync_index;
-    std::deque<std::future<void>> futures;
-
-    bool firstUpdate = true;
-};
+#pragma once
+
+#include "versioned.h"
+#include "segmented_index.h"
+#include "query_cache.h"
+#include "executor.h"
+#include "result_writer.h"
+#include "metrics.h"
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+
+struct SearchServerOptions {
+    // documents in the answer to a query; depths 1, 5, 10 and 20 are selected
+    // by kernels specialized for them, see SelectTop in scoring.h
+    size_t max_results = 5;
+    // workers of the executor answering queries and rebuilding the base
+    size_t threads = std::max(1u, std::thread::hardware_concurrency());
+    // query streams are split into chunks of this many lines answered in parallel
+    size_t query_chunk_lines = 64;
+    // Chunks of one stream queued for the workers at most; with this many out
+    // the reader answers the next chunk itself before reading on, so a long
+    // stream is not read into memory ahead of the answers. 0 means twice the threads.
+    size_t query_chunks_in_flight = 0;
+    // answer queries with MaxScore (see maxscore.h), skipping postings
+    // that cannot change the top. It pays off when the top hit counts are well
+    // above most documents, not on short lines where almost every one ties.
+    bool prune_queries = false;
+    // Split the docids of the base into this many ranges and score each
+    // query on all of them in parallel, merging the tops of the
+    // ranges. Cuts the latency of a single query; 1 scores it on one worker.
+    size_t query_shards = 1;
+    IndexBuildOptions index_build = {std::max(1u, std::thread::hardware_concurrency())};
+    // full checksum pass over index files on LoadDocumentBase
+    bool verify_index_files = true;
+    // tiered merging: this many segments of one size tier are merged into one
+    size_t segment_merge_factor = 4;
+    // top documents of this many recent queries are reused until the base changes; 0 disables
+    size_t query_cache_capacity = 4096;
+    // how AddQueriesStream writes answers, see result_writer.h
+    ResultFormat result_format = ResultFormat::TEXT;
+    // Heap bytes the server may take (ServerMemoryUsage::Total); 0 means no
+    // budget. The old base lives until a new one is built, so a rebuild or a
+    // batch of added documents gets what the current usage leaves and fails
+    // with std::runtime_error beyond it (see IndexBuildOptions::memory_limit);
+    // a merge that would not fit waits for a later one. AddDocument is not checked.
+    size_t memory_budget = 0;
+};
+
+// Heap bytes held by a server, see SearchServer::GetMemoryUsage().
+struct ServerMemoryUsage {
+    // the current base, its deletion bitmap and docid tables counted as documents
+    IndexMemoryUsage index;
+    // hit counters, touched docids and query words of the threads answering queries
+    size_t query_scratch = 0;
+    size_t query_cache = 0;
+
+    size_t Total() const {
+        return index.Total() + query_scratch + query_cache;
+    }
+
+    // {"dictionary": 1024, "postings": ..., "documents": ..., "mapped": ...,
+    //  "query_scratch": ..., "query_cache": ..., "total": ...}
+    std::string ToJson() const;
+};
+
+class SearchServer {
+public:
+    explicit SearchServer(const SearchServerOptions& options = {});
+
+    explicit SearchServer(std::istream& document_input, const SearchServerOptions& options = {});
+
+    void UpdateDocumentBase(std::istream& document_input);
+
+    // switches to an index file written by InvertedIndex::Save
+    void LoadDocumentBase(const std::string& index_path);
+
+    // Incremental changes to the current base. New documents form a new
+    // segment and get the docids following the existing ones; a removed
+    // document keeps its docid but never matches again. Small segments are
+    // merged in the background. A later UpdateDocumentBase replaces them all.
+    size_t AddDocument(std::string document);
+
+    // returns the docid of the first added document
+    size_t AddDocuments(std::istream& document_input);
+
+    void RemoveDocument(size_t docid);
+
+    // Answers every line of `query_input`; chunks of lines are answered in
+    // parallel and written to `search_results_output` in the original order.
+    // A chunk that fails gets one "error: <reason>" line per query in its place
+    // and its exception is rethrown by Synchronize().
+    // Both streams must stay alive until Synchronize() returns.
+    void AddQueriesStream(std::istream& query_input, std::ostream& search_results_output);
+
+    // Answers `queries` like AddQueriesStream and passes all answers, in order,
+    // to `done`, which runs on the worker finishing last (or right away if
+    // there are no queries). Queries of a chunk that fails are answered with
+    // "error: <reason>" lines.
+    void AnswerQueries(std::vector<std::string> queries, std::function<void(std::string answers)> done);
+
+    // Replaces the base with the lines of the file at `path`, read on a worker,
+    // then calls `done` there with an empty string, or why the file was not used.
+    void UpdateDocumentBase(const std::string& path, std::function<void(std::string error)> done);
+
+    // waits for all queries, updates and merges submitted so far
+    void Synchronize();
+
+    QueryCache::Stats GetQueryCacheStats() const {
+        return query_cache.GetStats();
+    }
+
+    // counters and per-phase latency histograms since construction; ToJson() dumps them
+    Metrics::Snapshot GetMetrics() const {
+        return metrics.Read();
+    }
+
+    // Memory taken now, per structure. Bases still read by queries that
+    // started before the last change are not counted.
+    ServerMemoryUsage GetMemoryUsage() const;
+
+private:
+    // options.index_build limited to what options.memory_budget leaves;
+    // throws std::runtime_error if nothing is left
+    IndexBuildOptions BuildOptionsWithinBudget() const;
+
+    size_t AddSegment(InvertedIndex segment);
+
+    void ScheduleMerges();
+
+    void MergeSegments();
+
+    // merges while the policy finds work that fits; returns the generation
+    // of the base it found none in
+    uint64_t MergeWhileWork();
+
+    const SearchServerOptions options;
+    Versioned<SegmentedIndex> index_versions;
+    std::atomic<bool> merge_running = false;
+    QueryCache query_cache;
+    Metrics metrics;
+    // declared last: destroying it waits for tasks that still use the members above
+    Executor executor;
+
+    bool firstUpdate = true;
+};
@@ -0,0 +1,161 @@
+#include "segmented_index.h"
+
+#include <algorithm>
+
+SegmentedIndex::SegmentedIndex(InvertedIndex index) {
+    segments.push_back({std::make_shared<const InvertedIndex>(std::move(index)), 0});
+    MapDocids();
+}
+
+void SegmentedIndex::MapDocids() {
+    const auto last = std::find_if(segments.rbegin(), segments.rend(), [](const IndexSegment& segment) {
+        return segment.index->OriginalDocids() != nullptr;
+    });
+    if (last == segments.rend()) {
+        original_docids.reset();
+        internal_docids.reset();
+        return;
+    }
+
+    auto originals = std::make_shared<std::vector<uint32_t>>();
+    originals->reserve(last->first_docid + last->index->GetDocsSize());
+    for (const auto& [index, first_docid] : segments) {
+        const uint32_t* segment_docids = index->OriginalDocids();
+        for (size_t docid = 0; docid < index->GetDocsSize(); ++docid) {
+            originals->push_back(first_docid + (segment_docids ? segment_docids[docid] : docid));
+        }
+        if (index == last->index) {
+            break;
+        }
+    }
+    auto internals = std::make_shared<std::vector<uint32_t>>(originals->size());
+    for (size_t docid = 0; docid < originals->size(); ++docid) {
+        (*internals)[(*originals)[docid]] = docid;
+    }
+    original_docids = std::move(originals);
+    internal_docids = std::move(internals);
+}
+
+IndexMemoryUsage SegmentedIndex::GetMemoryUsage() const {
+    IndexMemoryUsage usage;
+    for (const IndexSegment& segment : segments) {
+        usage += segment.index->GetMemoryUsage();
+    }
+    for (const auto& table : {original_docids, internal_docids}) {
+        usage.documents += table ? table->capacity() * sizeof(uint32_t) : 0;
+    }
+    usage.documents += deleted ? deleted->capacity() * sizeof(uint64_t) : 0;
+    return usage;
+}
+
+void SegmentedIndex::AddHits(std::string_view word, size_t first, size_t last, HitAccumulator& accumulator) const {
+    for (const auto& [index, first_docid] : segments) {
+        if (first_docid >= last || first_docid + index->GetDocsSize() <= first) {
+            continue;
+        }
+        const PostingList list = index->Lookup(word);
+        if (list.Size() == 0) {
+            continue;
+        }
+        PostingCursor cursor(list);
+        cursor.Advance(first > first_docid ? first - first_docid : 0);
+        for (const size_t end = last - first_docid; cursor.Docid() < end; cursor.Next()) {
+            const size_t docid = first_docid + cursor.Docid();
+            if (!IsDeleted(docid)) {
+                accumulator.Add(docid, cursor.Hits());
+            }
+        }
+    }
+}
+
+SegmentedIndex SegmentedIndex::Append(InvertedIndex index) const {
+    SegmentedIndex result = *this;
+    const size_t first_docid = GetDocsSize();
+    result.segments.push_back({std::make_shared<const InvertedIndex>(std::move(index)), first_docid});
+    if (result.segments.back().index->OriginalDocids()) {
+        result.MapDocids();
+    }
+    return result;
+}
+
+SegmentedIndex SegmentedIndex::Delete(size_t docid) const {
+    docid = InternalDocid(docid);
+    if (docid >= GetDocsSize() || IsDeleted(docid)) {
+        return *this;
+    }
+
+    auto bitmap = deleted ? std::make_shared<std::vector<uint64_t>>(*deleted)
+                          : std::make_shared<std::vector<uint64_t>>();
+    bitmap->resize(std::max(bitmap->size(), GetDocsSize() / 64 + 1), 0);
+    (*bitmap)[docid / 64] |= uint64_t(1) << (docid % 64);
+
+    SegmentedIndex result = *this;
+    result.deleted = std::move(bitmap);
+    return result;
+}
+
+std::optional<std::pair<size_t, size_t>> SegmentedIndex::PickMerge(size_t factor) const {
+    if (factor < 2 || segments.size() < factor) {
+        return std::nullopt;
+    }
+
+    auto tier = [factor](size_t docs) {
+        size_t result = 0;
+        for (; docs >= factor; docs /= factor) {
+            ++result;
+        }
+        return result;
+    };
+
+    const size_t first = segments.size() - factor;
+    const size_t last_tier = tier(segments.back().index->GetDocsSize());
+    for (size_t i = first; i < segments.size(); ++i) {
+        if (tier(segments[i].index->GetDocsSize()) != last_tier) {
+            return std::nullopt;
+        }
+    }
+    return std::make_pair(first, segments.size());
+}
+
+InvertedIndex SegmentedIndex::MergeSegments(size_t first, size_t last, const IndexBuildOptions& options) const {
+    std::vector<const InvertedIndex*> parts;
+    for (size_t i = first; i < last; ++i) {
+        parts.push_back(segments[i].index.get());
+    }
+
+    const size_t first_docid = segments[first].first_docid;
+    InvertedIndex merged = InvertedIndex::Concatenate(parts, [this, first_docid](size_t docid) {
+        return IsDeleted(first_docid + docid);
+    });
+    if (options.compress_postings) {
+        merged.Compress();
+    } else {
+        merged.Freeze();
+    }
+    return merged;
+}
+
+std::optional<SegmentedIndex> SegmentedIndex::Replace(const SegmentedIndex& source, size_t first, size_t last,
+                                                      InvertedIndex merged) const {
+    // segments are immutable and never move to other docids, so finding the
+    // same objects at the same position means the merge is still valid
+    const auto start = std::find_if(segments.begin(), segments.end(), [&](const IndexSegment& segment) {
+        return segment.index == source.segments[first].index;
+    });
+    const auto count = static_cast<std::ptrdiff_t>(last - first);
+    if (start == segments.end() || segments.end() - start < count
+        || !std::equal(start, start + count, source.segments.begin() + first,
+                       [](const IndexSegment& lhs, const IndexSegment& rhs) { return lhs.index == rhs.index; })) {
+        return std::nullopt;
+    }
+
+    // a merged segment numbers its documents like its parts together, the tables stay valid
+    SegmentedIndex result;
+    result.deleted = deleted;
+    result.original_docids = original_docids;
+    result.internal_docids = internal_docids;
+    result.segments.assign(segments.begin(), start);
+    result.segments.push_back({std::make_shared<const InvertedIndex>(std::move(merged)), start->first_docid});
+    result.segments.insert(result.segments.end(), start + count, segments.end());
+    return result;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "inverted_index.h"
+#include "scoring.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// One immutable piece of the document base: an index over docids
+// [first_docid, first_docid + index->GetDocsSize()).
+struct IndexSegment {
+    std::shared_ptr<const InvertedIndex> index;
+    size_t first_docid;
+};
+
+// Document base made of segments covering consecutive docid ranges, plus a
+// bitmap of deleted docids. Values are immutable: every change returns a new
+// SegmentedIndex sharing the untouched segments with the old one.
+//
+// A deleted document keeps its docid and simply stops matching, so the base
+// answers queries exactly like a single index built from the same documents
+// with the deleted lines left empty.
+class SegmentedIndex {
+public:
+    SegmentedIndex() = default;
+
+    explicit SegmentedIndex(InvertedIndex index);
+
+    size_t GetDocsSize() const {
+        return segments.empty() ? 0 : segments.back().first_docid + segments.back().index->GetDocsSize();
+    }
+
+    bool IsDeleted(size_t docid) const {
+        // the bitmap only covers docids that existed at the last deletion
+        return deleted && docid / 64 < deleted->size() && (*deleted)[docid / 64] >> (docid % 64) & 1;
+    }
+
+    const std::vector<IndexSegment>& GetSegments() const {
+        return segments;
+    }
+
+    // Docids of the documents as read by the segments' indexes when some of
+    // them were reordered (InvertedIndex::OriginalDocids); empty otherwise.
+    // Answers and Delete() use these docids.
+    DocidMap OriginalDocids() const {
+        return original_docids ? DocidMap{original_docids->data(), original_docids->size()} : DocidMap();
+    }
+
+    // the docid in this base of the document with original docid `docid`
+    size_t InternalDocid(size_t docid) const {
+        return internal_docids && docid < internal_docids->size() ? (*internal_docids)[docid] : docid;
+    }
+
+    // usage of all segments; the deletion bitmap and the docid tables count as documents
+    IndexMemoryUsage GetMemoryUsage() const;
+
+    // calls callback(docid, hits) for every live document containing `word`, in docid order
+    template<typename Callback>
+    void ForEachHit(std::string_view word, Callback callback) const {
+        for (const auto& [index, first_docid] : segments) {
+            if (!deleted) {
+                index->Lookup(word).ForEach([&callback, first_docid = first_docid](size_t docid, size_t hits) {
+                    callback(first_docid + docid, hits);
+                });
+            } else {
+                index->Lookup(word).ForEach([this, &callback, first_docid = first_docid](size_t docid, size_t hits) {
+                    if (!IsDeleted(first_docid + docid)) {
+                        callback(first_docid + docid, hits);
+                    }
+                });
+            }
+        }
+    }
+
+    // adds hits of every live document containing `word` to `accumulator`
+    void AddHits(std::string_view word, HitAccumulator& accumulator) const {
+        ForEachHit(word, [&accumulator](size_t docid, size_t hits) {
+            accumulator.Add(docid, hits);
+        });
+    }
+
+    // same for the documents in [first, last) only; other postings are skipped block-wise
+    void AddHits(std::string_view word, size_t first, size_t last, HitAccumulator& accumulator) const;
+
+    // documents of `index` get the docids following the current ones
+    SegmentedIndex Append(InvertedIndex index) const;
+
+    // `docid` is an original docid, see OriginalDocids()
+    SegmentedIndex Delete(size_t docid) const;
+
+    // Range [first, last) of segments that the tiered policy wants merged:
+    // the trailing `factor` segments when they are all of the same size tier
+    // (tier k holds segments of factor^k to factor^(k+1) - 1 documents).
+    std::optional<std::pair<size_t, size_t>> PickMerge(size_t factor) const;
+
+    // Merges segments [first, last) into one index, dropping postings of
+    // deleted documents. Runs without any lock; the result is applied by Replace().
+    InvertedIndex MergeSegments(size_t first, size_t last, const IndexBuildOptions& options) const;
+
+    // Puts `merged` in place of the segments of `source` in [first, last),
+    // if they are all still part of this index; otherwise returns nullopt.
+    std::optional<SegmentedIndex> Replace(const SegmentedIndex& source, size_t first, size_t last,
+                                          InvertedIndex merged) const;
+
+private:
+    // rebuilds the docid tables up to the end of the last reordered segment
+    void MapDocids();
+
+    std::vector<IndexSegment> segments;
+    std::shared_ptr<const std::vector<uint64_t>> deleted;
+    // original docid of every docid, and back; null if no segment is reordered
+    std::shared_ptr<const std::vector<uint32_t>> original_docids;
+    std::shared_ptr<const std::vector<uint32_t>> internal_docids;
+};
@@ -0,0 +1,94 @@
+#include "term_dictionary.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+TermDictionary::TermDictionary() :
+        slots(16, Slot{0, 0, EMPTY}),
+        offsets(1, 0)
+{
+}
+
+TermDictionary::TermDictionary(const Layout& layout) :
+        external(layout)
+{
+}
+
+uint64_t TermDictionary::Hash(std::string_view term) {
+    // FNV-1a with a final avalanche; stable across runs and platforms
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : term) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+size_t TermDictionary::Probe(const Layout& layout, std::string_view term, uint64_t hash) {
+    const size_t mask = layout.slot_count - 1;
+    for (size_t pos = hash & mask; ; pos = (pos + 1) & mask) {
+        const Slot& slot = layout.slots[pos];
+        if (slot.term_id == EMPTY) {
+            return pos;
+        }
+        if (slot.hash == hash && slot.length == term.size()
+            && std::memcmp(layout.pool + layout.offsets[slot.term_id], term.data(), term.size()) == 0) {
+            return pos;
+        }
+    }
+}
+
+uint32_t TermDictionary::Find(std::string_view term) const {
+    const Layout layout = GetLayout();
+    const Slot& slot = layout.slots[Probe(layout, term, Hash(term))];
+    return slot.term_id == EMPTY ? NOT_FOUND : slot.term_id;
+}
+
+uint32_t TermDictionary::Insert(std::string_view term) {
+    if (external) {
+        throw std::logic_error("TermDictionary::Insert: dictionary is read-only");
+    }
+
+    const uint64_t hash = Hash(term);
+    size_t pos = Probe(GetLayout(), term, hash);
+    if (slots[pos].term_id != EMPTY) {
+        return slots[pos].term_id;
+    }
+
+    // offsets into the pool are 32-bit
+    if (pool.size() + term.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("TermDictionary::Insert: more than 4 GiB of distinct terms, "
+                                + std::to_string(pool.size()) + " bytes so far");
+    }
+    const auto term_id = static_cast<uint32_t>(Size());
+    pool.append(term.data(), term.size());
+    offsets.push_back(static_cast<uint32_t>(pool.size()));
+    slots[pos] = {hash, static_cast<uint32_t>(term.size()), term_id};
+
+    if (2 * Size() > slots.size()) {
+        Grow();
+    }
+    return term_id;
+}
+
+void TermDictionary::Grow() {
+    std::vector<Slot> old_slots(2 * slots.size(), Slot{0, 0, EMPTY});
+    old_slots.swap(slots);
+
+    // stored hashes are enough to re-place every term, keys are never re-read
+    const size_t mask = slots.size() - 1;
+    for (const Slot& slot : old_slots) {
+        if (slot.term_id == EMPTY) {
+            continue;
+        }
+        size_t pos = slot.hash & mask;
+        while (slots[pos].term_id != EMPTY) {
+            pos = (pos + 1) & mask;
+        }
+        slots[pos] = slot;
+    }
+}
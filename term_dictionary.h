@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Maps terms to dense ids 0, 1, 2, ... in order of first insertion.
+// Open addressing with linear probing over a flat slot array: every slot keeps
+// the full hash and the key length, so a probe only touches the key bytes
+// (stored back to back in one pool) when both of them match.
+class TermDictionary {
+public:
+    static constexpr uint32_t NOT_FOUND = UINT32_MAX;
+
+    struct Slot {
+        uint64_t hash;
+        uint32_t length;
+        uint32_t term_id;
+    };
+
+    // The flat arrays behind a dictionary. Contains no pointers of its own,
+    // so it can be written to a file and used again from a mapping of it.
+    struct Layout {
+        const Slot* slots;       // slot_count is a power of two
+        size_t slot_count;
+        const char* pool;        // key bytes of all terms in id order
+        size_t pool_size;
+        const uint32_t* offsets; // term id -> start in pool, plus end sentinel
+        size_t terms;
+    };
+
+    TermDictionary();
+
+    // read-only dictionary over arrays owned by someone else, e.g. a mapped file
+    explicit TermDictionary(const Layout& layout);
+
+    // id of `term`, adding it first if it is new; throws std::length_error
+    // if the distinct terms would take more than 4 GiB
+    uint32_t Insert(std::string_view term);
+
+    // id of `term` or NOT_FOUND
+    uint32_t Find(std::string_view term) const;
+
+    std::string_view Term(uint32_t term_id) const {
+        const Layout layout = GetLayout();
+        return {layout.pool + layout.offsets[term_id], layout.offsets[term_id + 1] - layout.offsets[term_id]};
+    }
+
+    size_t Size() const {
+        return external ? external->terms : offsets.size() - 1;
+    }
+
+    Layout GetLayout() const {
+        if (external) {
+            return *external;
+        }
+        return {slots.data(), slots.size(), pool.data(), pool.size(), offsets.data(), offsets.size() - 1};
+    }
+
+    // heap bytes of the table, the term bytes and the offsets; 0 over external storage
+    size_t MemoryBytes() const {
+        return slots.capacity() * sizeof(Slot) + pool.capacity() + offsets.capacity() * sizeof(uint32_t);
+    }
+
+    static uint64_t Hash(std::string_view term);
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    // first slot that either holds `term` or is empty
+    static size_t Probe(const Layout& layout, std::string_view term, uint64_t hash);
+
+    void Grow();
+
+    std::vector<Slot> slots;    // at most half full
+    std::string pool;
+    std::vector<uint32_t> offsets;
+    std::optional<Layout> external;
+};
@@ -1,244 +1,1526 @@
-#pragma once
-
-// testing
-#include "test_runner.h"
-#include "profile.h"
-
-#include "search_server.h"
-#include "parse.h"
-
-#include <string>
-#include <vector>
-#include <fstream>
-
-void TestFunctionality(
-        const std::vector<std::string>& docs,
-        const std::vector<std::string>& queries,
-        const std::vector<std::string>& expected
-) {
-    std::istringstream docs_input(Join('\n', docs));
-    std::istringstream queries_input(Join('\n', queries));
-
-    SearchServer srv;
-    {
-        LOG_DURATION("Load documents");
-        srv.UpdateDocumentBase(docs_input);
-
-    }
-
-    std::ostringstream queries_output;
-    {
-        LOG_DURATION("Get response");
-        srv.AddQueriesStream(queries_input, queries_output);
-    }
-
-    srv.Synchronize();
-
-    const std::string result = queries_output.str();
-
-    const auto lines = SplitBy(Strip(result), '\n');
-    ASSERT_EQUAL(lines.size(), expected.size());
-    for (size_t i = 0; i < lines.size(); ++i) {
-        ASSERT_EQUAL(lines[i], expected[i]);
-    }
-}
-
-void TestSerpFormat() {
-    const std::vector<std::string> docs = {
-            "london    is   the capital  of great britain",
-            "i am travelling down the   river"
-    };
-    const std::vector<std::string> queries = {"london", "the"};
-    const std::vector<std::string> expected = {
-            "london: {docid: 0, hitcount: 1}",
-            Join(' ', std::vector{
-                    "the:",
-                    "{docid: 0, hitcount: 1}",
-                    "{docid: 1, hitcount: 1}"
-            })
-    };
-
-    TestFunctionality(docs, queries, expected);
-}
-
-void TestTop5() {
-    const std::vector<std::string> docs = {
-            "milk a",
-            "milk b",
-            "milk c",
-            "milk d",
-            "milk e",
-            "milk f",
-            "milk g",
-            "water a",
-            "water b",
-            "fire and earth"
-    };
-
-    const std::vector<std::string> queries = {"milk", "water", "rock"};
-    const std::vector<std::string> expected = {
-            Join(' ', std::vector{
-                    "milk:",
-                    "{docid: 0, hitcount: 1}",
-                    "{docid: 1, hitcount: 1}",
-                    "{docid: 2, hitcount: 1}",
-                    "{docid: 3, hitcount: 1}",
-                    "{docid: 4, hitcount: 1}"
-            }),
-            Join(' ', std::vector{
-                    "water:",
-                    "{docid: 7, hitcount: 1}",
-                    "{docid: 8, hitcount: 1}",
-            }),
-            "rock:",
-    };
-    TestFunctionality(docs, queries, expected);
-}
-
-void TestHitcount() {
-    const std::vector<std::string> docs = {
-            "the river goes through the entire city there is a house near it",
-            "the wall",
-            "walle",
-            "is is is is",
-    };
-    const std::vector<std::string> queries = {"the", "wall", "all", "is", "the is"};
-    const std::vector<std::string> expected = {
-            Join(' ', std::vector{
-                    "the:",
-                    "{docid: 0, hitcount: 2}",
-                    "{docid: 1, hitcount: 1}",
-            }),
-            "wall: {docid: 1, hitcount: 1}",
-            "all:",
-            Join(' ', std::vector{
-                    "is:",
-                    "{docid: 3, hitcount: 4}",
-                    "{docid: 0, hitcount: 1}",
-            }),
-            Join(' ', std::vector{
-                    "the is:",
-                    "{docid: 3, hitcount: 4}",
-                    "{docid: 0, hitcount: 3}",
-                    "{docid: 1, hitcount: 1}",
-            }),
-    };
-    TestFunctionality(docs, queries, expected);
-}
-
-void TestRanking() {
-    const std::vector<std::string> docs = {
-            "london is the capital of great britain",
-            "paris is the capital of france",
-            "berlin is the capital of germany",
-            "rome is the capital of italy",
-            "madrid is the capital of spain",
-            "lisboa is the capital of portugal",
-            "bern is the capital of switzerland",
-            "moscow is the capital of russia",
-            "kiev is the capital of ukraine",
-            "minsk is the capital of belarus",
-            "astana is the capital of kazakhstan",
-            "beijing is the capital of china",
-            "tokyo is the capital of japan",
-            "bangkok is the capital of thailand",
-            "welcome to moscow the capital of russia the third rome",
-            "amsterdam is the capital of netherlands",
-            "helsinki is the capital of finland",
-            "oslo is the capital of norway",
-            "stockgolm is the capital of sweden",
-            "riga is the capital of latvia",
-            "tallin is the capital of estonia",
-            "warsaw is the capital of poland",
-    };
-
-    const std::vector<std::string> queries = {"moscow is the capital of russia"};
-    const std::vector<std::string> expected = {
-            Join(' ', std::vector{
-                    "moscow is the capital of russia:",
-                    "{docid: 7, hitcount: 6}",
-                    "{docid: 14, hitcount: 6}",
-                    "{docid: 0, hitcount: 4}",
-                    "{docid: 1, hitcount: 4}",
-                    "{docid: 2, hitcount: 4}",
-            })
-    };
-    TestFunctionality(docs, queries, expected);
-}
-
-void TestBasicSearch() {
-    const std::vector<std::string> docs = {
-            "we are ready to go",
-            "come on everybody shake you hands",
-            "i love this game",
-            "just like exception safety is not about writing try catch everywhere in your code move semantics are not about typing double ampersand everywhere in your code",
-            "daddy daddy daddy dad dad dad",
-            "tell me the meaning of being lonely",
-            "just keep track of it",
-            "how hard could it be",
-            "it is going to be legen wait for it dary legendary",
-            "we dont need no education"
-    };
-
-    const std::vector<std::string> queries = {
-            "we need some help",
-            "it",
-            "i love this game",
-            "tell me why",
-            "dislike",
-            "about"
-    };
-
-    const std::vector<std::string> expected = {
-            Join(' ', std::vector{
-                    "we need some help:",
-                    "{docid: 9, hitcount: 2}",
-                    "{docid: 0, hitcount: 1}"
-            }),
-            Join(' ', std::vector{
-                    "it:",
-                    "{docid: 8, hitcount: 2}",
-                    "{docid: 6, hitcount: 1}",
-                    "{docid: 7, hitcount: 1}",
-            }),
-            "i love this game: {docid: 2, hitcount: 4}",
-            "tell me why: {docid: 5, hitcount: 2}",
-            "dislike:",
-            "about: {docid: 3, hitcount: 2}",
-    };
-
-    TestFunctionality(docs, queries, expected);
-}
-
-void TestMultithreading() {
-    std::ifstream f1("/home/niko/CLionProjects/FinalRedBelt/SearchEngine/input/file1.txt", std::ifstream::in);
-    std::ifstream f2("/home/niko/CLionProjects/FinalRedBelt/SearchEngine/input/file2.txt", std::ifstream::in);
-
-    std::vector<std::ifstream> queries_inputs(8);
-    std::string input_path = __FILE__;
-    input_path = input_path.substr(0, input_path.find("tests.h")) + "input/queries0.txt";
-    size_t num_pos = input_path.find(".txt") - 1;
-
-    // /home/niko/CLionProjects/FinalRedBelt/SearchEngine/input/queries1.txt
-    for (size_t i = 0; i < queries_inputs.size(); ++i) {
-        input_path[num_pos] = '1' + i;
-        std::cout << input_path << std::endl;
-        queries_inputs[i] = std::ifstream(input_path);
-    }
-
-    SearchServer srv;
-    {
-        LOG_DURATION("Load documents");
-        srv.UpdateDocumentBase(f1);
-
-    }
-
-    std::vector<std::ostringstream> queries_outputs(queries_inputs.size());
-    {
-        LOG_DURATION("Get response");
-        for(size_t i = 0; i < queries_outputs.size(); ++i) {
-            srv.AddQueriesStream(queries_inputs[i], queries_outputs[i]);
-        }
-        srv.Synchronize();
-    }
-}
\ No newline at end of file
+#pragma once
+
+// testing
+#include "test_runner.h"
+#include "profile.h"
+
+#include "search_server.h"
+#include "parse.h"
+#include "scoring.h"
+#include "term_dictionary.h"
+#include "maxscore.h"
+#include "executor.h"
+#include "daemon.h"
+#include "coordinator.h"
+#include "query_cache.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <functional>
+#include <deque>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+void TestFunctionality(
+        const std::vector<std::string>& docs,
+        const std::vector<std::string>& queries,
+        const std::vector<std::string>& expected
+) {
+    std::istringstream docs_input(Join('\n', docs));
+    std::istringstream queries_input(Join('\n', queries));
+
+    SearchServer srv;
+    {
+        LOG_DURATION("Load documents");
+        srv.UpdateDocumentBase(docs_input);
+
+    }
+
+    std::ostringstream queries_output;
+    {
+        LOG_DURATION("Get response");
+        srv.AddQueriesStream(queries_input, queries_output);
+    }
+
+    srv.Synchronize();
+
+    const std::string result = queries_output.str();
+
+    const auto lines = SplitBy(Strip(result), '\n');
+    ASSERT_EQUAL(lines.size(), expected.size());
+    for (size_t i = 0; i < lines.size(); ++i) {
+        ASSERT_EQUAL(lines[i], expected[i]);
+    }
+}
+
+// `lines_num` lines of 1 to `max_words` random words of `vocabulary`, each
+// after one or two spaces
+std::vector<std::string> RandomLines(std::mt19937& gen, const std::vector<std::string>& vocabulary,
+                                     size_t lines_num, size_t max_words = 5) {
+    std::vector<std::string> lines(lines_num);
+    for (auto& line : lines) {
+        for (size_t i = 1 + gen() % max_words; i > 0; --i) {
+            line += std::string(1 + gen() % 2, ' ') + vocabulary[gen() % vocabulary.size()];
+        }
+    }
+    return lines;
+}
+
+// answers of `srv` to `queries` as one stream, after everything submitted before them
+std::string AnswerAll(SearchServer& srv, const std::vector<std::string>& queries) {
+    std::istringstream queries_input(Join('\n', queries));
+    std::ostringstream queries_output;
+    srv.AddQueriesStream(queries_input, queries_output);
+    srv.Synchronize();
+    return queries_output.str();
+}
+
+// answers of a server built on `docs`
+std::string AnswerAll(const std::vector<std::string>& docs, const std::vector<std::string>& queries,
+                      const SearchServerOptions& options = {}) {
+    std::istringstream docs_input(Join('\n', docs));
+    SearchServer srv(docs_input, options);
+    return AnswerAll(srv, queries);
+}
+
+void TestSerpFormat() {
+    const std::vector<std::string> docs = {
+            "london    is   the capital  of great britain",
+            "i am travelling down the   river"
+    };
+    const std::vector<std::string> queries = {"london", "the"};
+    const std::vector<std::string> expected = {
+            "london: {docid: 0, hitcount: 1}",
+            Join(' ', std::vector{
+                    "the:",
+                    "{docid: 0, hitcount: 1}",
+                    "{docid: 1, hitcount: 1}"
+            })
+    };
+
+    TestFunctionality(docs, queries, expected);
+}
+
+void TestTop5() {
+    const std::vector<std::string> docs = {
+            "milk a",
+            "milk b",
+            "milk c",
+            "milk d",
+            "milk e",
+            "milk f",
+            "milk g",
+            "water a",
+            "water b",
+            "fire and earth"
+    };
+
+    const std::vector<std::string> queries = {"milk", "water", "rock"};
+    const std::vector<std::string> expected = {
+            Join(' ', std::vector{
+                    "milk:",
+                    "{docid: 0, hitcount: 1}",
+                    "{docid: 1, hitcount: 1}",
+                    "{docid: 2, hitcount: 1}",
+                    "{docid: 3, hitcount: 1}",
+                    "{docid: 4, hitcount: 1}"
+            }),
+            Join(' ', std::vector{
+                    "water:",
+                    "{docid: 7, hitcount: 1}",
+                    "{docid: 8, hitcount: 1}",
+            }),
+            "rock:",
+    };
+    TestFunctionality(docs, queries, expected);
+}
+
+void TestHitcount() {
+    const std::vector<std::string> docs = {
+            "the river goes through the entire city there is a house near it",
+            "the wall",
+            "walle",
+            "is is is is",
+    };
+    const std::vector<std::string> queries = {"the", "wall", "all", "is", "the is"};
+    const std::vector<std::string> expected = {
+            Join(' ', std::vector{
+                    "the:",
+                    "{docid: 0, hitcount: 2}",
+                    "{docid: 1, hitcount: 1}",
+            }),
+            "wall: {docid: 1, hitcount: 1}",
+            "all:",
+            Join(' ', std::vector{
+                    "is:",
+                    "{docid: 3, hitcount: 4}",
+                    "{docid: 0, hitcount: 1}",
+            }),
+            Join(' ', std::vector{
+                    "the is:",
+                    "{docid: 3, hitcount: 4}",
+                    "{docid: 0, hitcount: 3}",
+                    "{docid: 1, hitcount: 1}",
+            }),
+    };
+    TestFunctionality(docs, queries, expected);
+}
+
+void TestRanking() {
+    const std::vector<std::string> docs = {
+            "london is the capital of great britain",
+            "paris is the capital of france",
+            "berlin is the capital of germany",
+            "rome is the capital of italy",
+            "madrid is the capital of spain",
+            "lisboa is the capital of portugal",
+            "bern is the capital of switzerland",
+            "moscow is the capital of russia",
+            "kiev is the capital of ukraine",
+            "minsk is the capital of belarus",
+            "astana is the capital of kazakhstan",
+            "beijing is the capital of china",
+            "tokyo is the capital of japan",
+            "bangkok is the capital of thailand",
+            "welcome to moscow the capital of russia the third rome",
+            "amsterdam is the capital of netherlands",
+            "helsinki is the capital of finland",
+            "oslo is the capital of norway",
+            "stockgolm is the capital of sweden",
+            "riga is the capital of latvia",
+            "tallin is the capital of estonia",
+            "warsaw is the capital of poland",
+    };
+
+    const std::vector<std::string> queries = {"moscow is the capital of russia"};
+    const std::vector<std::string> expected = {
+            Join(' ', std::vector{
+                    "moscow is the capital of russia:",
+                    "{docid: 7, hitcount: 6}",
+                    "{docid: 14, hitcount: 6}",
+                    "{docid: 0, hitcount: 4}",
+                    "{docid: 1, hitcount: 4}",
+                    "{docid: 2, hitcount: 4}",
+            })
+    };
+    TestFunctionality(docs, queries, expected);
+}
+
+void TestBasicSearch() {
+    const std::vector<std::string> docs = {
+            "we are ready to go",
+            "come on everybody shake you hands",
+            "i love this game",
+            "just like exception safety is not about writing try catch everywhere in your code move semantics are not about typing double ampersand everywhere in your code",
+            "daddy daddy daddy dad dad dad",
+            "tell me the meaning of being lonely",
+            "just keep track of it",
+            "how hard could it be",
+            "it is going to be legen wait for it dary legendary",
+            "we dont need no education"
+    };
+
+    const std::vector<std::string> queries = {
+            "we need some help",
+            "it",
+            "i love this game",
+            "tell me why",
+            "dislike",
+            "about"
+    };
+
+    const std::vector<std::string> expected = {
+            Join(' ', std::vector{
+                    "we need some help:",
+                    "{docid: 9, hitcount: 2}",
+                    "{docid: 0, hitcount: 1}"
+            }),
+            Join(' ', std::vector{
+                    "it:",
+                    "{docid: 8, hitcount: 2}",
+                    "{docid: 6, hitcount: 1}",
+                    "{docid: 7, hitcount: 1}",
+            }),
+            "i love this game: {docid: 2, hitcount: 4}",
+            "tell me why: {docid: 5, hitcount: 2}",
+            "dislike:",
+            "about: {docid: 3, hitcount: 2}",
+    };
+
+    TestFunctionality(docs, queries, expected);
+}
+
+void TestMultithreading() {
+    std::string input_dir = __FILE__;
+    input_dir = input_dir.substr(0, input_dir.find("tests.h")) + "input/";
+    std::ifstream f1(input_dir + "file1.txt", std::ifstream::in);
+    ASSERT(f1.is_open());
+
+    // a missing queries file is just an empty stream
+    std::vector<std::ifstream> queries_inputs(8);
+    for (size_t i = 0; i < queries_inputs.size(); ++i) {
+        queries_inputs[i] = std::ifstream(input_dir + "queries" + std::to_string(i + 1) + ".txt");
+    }
+
+    SearchServer srv;
+    {
+        LOG_DURATION("Load documents");
+        srv.UpdateDocumentBase(f1);
+
+    }
+
+    std::vector<std::ostringstream> queries_outputs(queries_inputs.size());
+    {
+        LOG_DURATION("Get response");
+        for(size_t i = 0; i < queries_outputs.size(); ++i) {
+            srv.AddQueriesStream(queries_inputs[i], queries_outputs[i]);
+        }
+        srv.Synchronize();
+    }
+}
+
+void TestSnapshotConsistency() {
+    const std::string small_base = "a b\na";
+    const std::string large_base = "x\nx\nx\nx\nx\nx\nx\na a";
+    const std::string small_expected = "a: {docid: 0, hitcount: 1} {docid: 1, hitcount: 1}";
+    const std::string large_expected = "a: {docid: 7, hitcount: 2}";
+
+    std::istringstream first_input(small_base);
+    SearchServer srv(first_input);
+
+    const size_t QUERIES_NUM = 2000;
+    std::ostringstream queries;
+    for (size_t i = 0; i < QUERIES_NUM; ++i) {
+        queries << "a\n";
+    }
+    std::istringstream queries_input(queries.str());
+    std::ostringstream queries_output;
+    srv.AddQueriesStream(queries_input, queries_output);
+
+    std::deque<std::istringstream> updates;
+    for (size_t i = 0; i < 50; ++i) {
+        updates.emplace_back(i % 2 == 0 ? large_base : small_base);
+        srv.UpdateDocumentBase(updates.back());
+    }
+    srv.Synchronize();
+
+    const std::string result = queries_output.str();
+    const auto lines = SplitBy(Strip(result), '\n');
+    ASSERT_EQUAL(lines.size(), QUERIES_NUM);
+    for (auto line : lines) {
+        ASSERT(line == small_expected || line == large_expected);
+    }
+}
+
+
+void TestSelectTopDocs() {
+    std::mt19937 gen(42);
+    HitAccumulator accumulator;
+
+    for (size_t round = 0; round < 200; ++round) {
+        const size_t docs_num = 1 + gen() % 80;
+        // the specialized depths and a few around them that take the heap
+        const size_t depths[] = {0, 1, 2, 4, 5, 6, 10, 11, 20, 21, 50};
+        const size_t max_docs = depths[gen() % std::size(depths)];
+
+        std::vector<size_t> doc_counts(docs_num, 0);
+        accumulator.Reset(docs_num);
+        for (size_t i = gen() % 60; i > 0; --i) {
+            const size_t docid = gen() % docs_num;
+            const size_t hits = 1 + gen() % 3;
+            doc_counts[docid] += hits;
+            accumulator.Add(docid, hits);
+        }
+
+        std::vector<size_t> docids(docs_num);
+        std::iota(docids.begin(), docids.end(), 0);
+        std::partial_sort(docids.begin(), Head(docids, max_docs).end(), docids.end(),
+                          [&doc_counts](size_t lhs, size_t rhs) {
+                              return std::make_pair(doc_counts[lhs], rhs) > std::make_pair(doc_counts[rhs], lhs);
+                          });
+
+        std::vector<std::pair<size_t, size_t>> expected;
+        for (auto docid : Head(docids, max_docs)) {
+            if (doc_counts[docid] == 0) break;
+            expected.emplace_back(docid, doc_counts[docid]);
+        }
+
+        std::vector<std::pair<size_t, size_t>> actual;
+        for (auto [docid, hits] : SelectTopDocs(accumulator, max_docs)) {
+            actual.emplace_back(docid, hits);
+        }
+        ASSERT(actual == expected);
+    }
+
+    // the answers of a shallower server are prefixes of the deeper ones
+    const std::vector<std::string> docs = {"a b c", "a a", "b c c", "a", "c b a a", "b", "a c", "c c c", "a b", "b b a"};
+    auto answer = [&docs](size_t max_results) {
+        SearchServerOptions options;
+        options.max_results = max_results;
+        const std::string output = AnswerAll(docs, {"a", "b c", "a b c"}, options);
+        const auto lines = SplitBy(output, '\n');
+        return std::vector<std::string>(lines.begin(), lines.end());
+    };
+    const auto deepest = answer(50);
+    for (size_t max_results : {1, 3, 5, 10}) {
+        const auto answers = answer(max_results);
+        for (size_t i = 0; i < deepest.size(); ++i) {
+            std::string expected(deepest[i]);
+            size_t end = expected.find(" {");
+            for (size_t taken = 0; taken < max_results && end != std::string::npos; ++taken) {
+                end = expected.find(" {", end + 1);
+            }
+            ASSERT_EQUAL(answers.at(i), expected.substr(0, end));
+        }
+    }
+}
+
+
+void TestParallelIndexBuild() {
+    std::mt19937 gen(7);
+    std::vector<std::string> vocabulary = {"a", "b", "the", "of", "and", "london", "paris", "x"};
+    std::ostringstream corpus;
+    for (size_t docid = 0; docid < 300; ++docid) {
+        for (size_t i = gen() % 12; i > 0; --i) {
+            corpus << std::string(gen() % 3, ' ') << vocabulary[gen() % vocabulary.size()];
+        }
+        corpus << '\n';
+    }
+
+    std::istringstream sequential_input(corpus.str());
+    const InvertedIndex sequential(sequential_input);
+
+    for (size_t threads : {2, 3, 7, 1000}) {
+        std::istringstream parallel_input(corpus.str());
+        const InvertedIndex parallel(parallel_input, {threads});
+
+        ASSERT_EQUAL(parallel.GetDocsSize(), sequential.GetDocsSize());
+        for (size_t docid = 0; docid < sequential.GetDocsSize(); ++docid) {
+            ASSERT_EQUAL(parallel.GetDocument(docid), sequential.GetDocument(docid));
+        }
+        for (const auto& word : vocabulary) {
+            const auto expected = sequential.Lookup(word).ToVector();
+            const auto actual = parallel.Lookup(word).ToVector();
+            ASSERT_EQUAL(actual.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(actual[i].docid, expected[i].docid);
+                ASSERT_EQUAL(actual[i].hits, expected[i].hits);
+            }
+        }
+    }
+}
+
+
+void TestTermDictionary() {
+    TermDictionary dictionary;
+    ASSERT_EQUAL(dictionary.Find("london"), TermDictionary::NOT_FOUND);
+
+    std::vector<std::string> terms;
+    for (size_t i = 0; i < 5000; ++i) {
+        terms.push_back("term" + std::to_string(i * 7919 % 5000));
+    }
+    terms.push_back("");
+
+    for (size_t i = 0; i < terms.size(); ++i) {
+        ASSERT_EQUAL(dictionary.Insert(terms[i]), i);
+    }
+    ASSERT_EQUAL(dictionary.Size(), terms.size());
+
+    for (size_t i = 0; i < terms.size(); ++i) {
+        ASSERT_EQUAL(dictionary.Insert(terms[i]), i);
+        ASSERT_EQUAL(dictionary.Find(terms[i]), i);
+        ASSERT_EQUAL(dictionary.Term(i), terms[i]);
+    }
+    ASSERT_EQUAL(dictionary.Size(), terms.size());
+    ASSERT_EQUAL(dictionary.Find("term5000"), TermDictionary::NOT_FOUND);
+    ASSERT_EQUAL(dictionary.Find("term1 "), TermDictionary::NOT_FOUND);
+}
+
+
+void TestCompressedPostings() {
+    std::mt19937 gen(5);
+    for (size_t size : {0, 1, 3, 4, 15, 16, 17, 127, 128, 129, 1000}) {
+        for (size_t max_gap : {1, 200, 60000, 5000000}) {
+            std::vector<Item> items;
+            size_t docid = gen() % (max_gap + 1);
+            for (size_t i = 0; i < size; ++i) {
+                items.push_back({docid, 1 + gen() % (i % 2 == 0 ? 3 : 70000)});
+                docid += 1 + gen() % max_gap;
+            }
+
+            std::vector<uint8_t> blocks;
+            AppendCompressedPostings(items.data(), items.size(), blocks);
+            const auto decoded = PostingList(blocks.data(), blocks.size(), items.size()).ToVector();
+
+            ASSERT_EQUAL(decoded.size(), items.size());
+            for (size_t i = 0; i < items.size(); ++i) {
+                ASSERT_EQUAL(decoded[i].docid, items[i].docid);
+                ASSERT_EQUAL(decoded[i].hits, items[i].hits);
+            }
+        }
+    }
+
+    const std::string corpus = "the cat\nthe the dog\n\ncat and   the dog\nthe";
+    std::istringstream plain_input(corpus);
+    std::istringstream compressed_input(corpus);
+    const InvertedIndex plain(plain_input);
+    const InvertedIndex compressed(compressed_input, {1, true});
+    for (const char* word : {"the", "cat", "dog", "and", "bird"}) {
+        ASSERT(compressed.Lookup(word).IsCompressed() || compressed.Lookup(word).Size() == 0);
+        const auto expected = plain.Lookup(word).ToVector();
+        const auto actual = compressed.Lookup(word).ToVector();
+        ASSERT_EQUAL(actual.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(actual[i].docid, expected[i].docid);
+            ASSERT_EQUAL(actual[i].hits, expected[i].hits);
+        }
+    }
+
+    for (const Item item : {Item{size_t(1) << 32, 1}, Item{0, size_t(1) << 32}}) {
+        std::vector<uint8_t> blocks;
+        bool rejected = false;
+        try {
+            AppendCompressedPostings(&item, 1, blocks);
+        } catch (const std::overflow_error&) {
+            rejected = true;
+        }
+        ASSERT(rejected);
+    }
+}
+
+
+void TestIndexFile() {
+    const std::string corpus = "london is the capital of great britain\n"
+                               "\n"
+                               "the   river goes through the city\n"
+                               "paris is the capital of france";
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_test.idx").string();
+
+    for (bool compress : {false, true}) {
+        std::istringstream document_input(corpus);
+        const InvertedIndex built(document_input, {1, compress});
+        built.Save(path);
+        const InvertedIndex mapped = InvertedIndex::Map(path);
+
+        ASSERT_EQUAL(mapped.IsCompressed(), compress);
+        ASSERT_EQUAL(mapped.GetDocsSize(), built.GetDocsSize());
+        for (size_t docid = 0; docid < built.GetDocsSize(); ++docid) {
+            ASSERT_EQUAL(mapped.GetDocument(docid), built.GetDocument(docid));
+        }
+        const std::string words = corpus + " moscow";
+        for (auto word : SplitIntoWordsView(words)) {
+            const auto expected = built.Lookup(word).ToVector();
+            const auto actual = mapped.Lookup(word).ToVector();
+            ASSERT_EQUAL(actual.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(actual[i].docid, expected[i].docid);
+                ASSERT_EQUAL(actual[i].hits, expected[i].hits);
+            }
+        }
+    }
+
+    SearchServer srv;
+    srv.LoadDocumentBase(path);
+    std::istringstream queries_input("the capital\nriver");
+    std::ostringstream queries_output;
+    srv.AddQueriesStream(queries_input, queries_output);
+    srv.Synchronize();
+    ASSERT_EQUAL(queries_output.str(), "the capital: {docid: 0, hitcount: 2} {docid: 2, hitcount: 2} {docid: 3, hitcount: 2}\n"
+                                       "river: {docid: 2, hitcount: 1}\n");
+
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(-1, std::ios::end);
+        file.put('!');
+    }
+    bool rejected = false;
+    try {
+        InvertedIndex::Map(path);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    ASSERT(rejected);
+    std::filesystem::remove(path);
+}
+
+
+void TestIncrementalUpdates() {
+    std::mt19937 gen(11);
+    const std::vector<std::string> vocabulary = {"a", "b", "c", "the", "of", "x"};
+    // every line is non-empty, so that Join keeps trailing documents
+    auto random_document = [&] {
+        std::string document = " ";
+        for (size_t i = gen() % 6; i > 0; --i) {
+            document += vocabulary[gen() % vocabulary.size()] + " ";
+        }
+        return document;
+    };
+    const std::vector<std::string> queries = {"a", "b c", "the of the", "x a b", "z"};
+
+    std::vector<std::string> docs;
+    for (size_t i = 0; i < 20; ++i) {
+        docs.push_back(random_document());
+    }
+    std::istringstream base_input(Join('\n', docs));
+    SearchServer srv(base_input);
+
+    for (size_t step = 0; step < 150; ++step) {
+        if (gen() % 4 == 0) {
+            const size_t docid = gen() % docs.size();
+            srv.RemoveDocument(docid);
+            docs[docid] = " ";
+        } else if (gen() % 3 == 0) {
+            std::vector<std::string> batch = {random_document(), random_document()};
+            std::istringstream batch_input(Join('\n', batch));
+            ASSERT_EQUAL(srv.AddDocuments(batch_input), docs.size());
+            docs.insert(docs.end(), batch.begin(), batch.end());
+        } else {
+            docs.push_back(random_document());
+            ASSERT_EQUAL(srv.AddDocument(docs.back()), docs.size() - 1);
+        }
+
+        if (step % 10 == 0) {
+            std::istringstream rebuild_input(Join('\n', docs));
+            SearchServer rebuilt(rebuild_input);
+            ASSERT_EQUAL(AnswerAll(srv, queries), AnswerAll(rebuilt, queries));
+        }
+    }
+}
+
+
+void TestQueryCache() {
+    std::istringstream first_base("london is the capital\nthe river\nparis");
+    SearchServer srv(first_base);
+
+    auto search = [&srv](const std::string& queries) {
+        std::istringstream queries_input(queries);
+        std::ostringstream queries_output;
+        srv.AddQueriesStream(queries_input, queries_output);
+        srv.Synchronize();
+        return queries_output.str();
+    };
+
+    ASSERT_EQUAL(search("the river\nriver   the\nthe river\nparis"),
+                 "the river: {docid: 1, hitcount: 2} {docid: 0, hitcount: 1}\n"
+                 "river   the: {docid: 1, hitcount: 2} {docid: 0, hitcount: 1}\n"
+                 "the river: {docid: 1, hitcount: 2} {docid: 0, hitcount: 1}\n"
+                 "paris: {docid: 2, hitcount: 1}\n");
+    ASSERT_EQUAL(srv.GetQueryCacheStats().hits, 2u);
+    ASSERT_EQUAL(srv.GetQueryCacheStats().misses, 2u);
+
+    std::istringstream second_base("paris\nriver river");
+    srv.UpdateDocumentBase(second_base);
+    srv.Synchronize();
+    ASSERT_EQUAL(search("the river\nparis"),
+                 "the river: {docid: 1, hitcount: 2}\n"
+                 "paris: {docid: 0, hitcount: 1}\n");
+    ASSERT_EQUAL(srv.GetQueryCacheStats().hits, 2u);
+
+    srv.AddDocument("paris paris");
+    ASSERT_EQUAL(search("paris"), "paris: {docid: 2, hitcount: 2} {docid: 0, hitcount: 1}\n");
+
+    QueryCache cache(4, 1);
+    std::vector<Item> top_docs;
+    cache.Insert("paris", 2, {{0, 1}});
+    ASSERT(!cache.Find("paris", 1, top_docs));
+    ASSERT(cache.Find("paris", 2, top_docs));
+    ASSERT(!cache.Find("paris", 3, top_docs));
+    ASSERT(!cache.Find("paris", 2, top_docs));
+}
+
+
+void TestChunkedQueryStreams() {
+    std::mt19937 gen(3);
+    const std::vector<std::string> vocabulary = {"a", "b", "c", "the", "of", "x", "y"};
+    const auto docs = RandomLines(gen, vocabulary, 200);
+    const auto queries = RandomLines(gen, vocabulary, 500);
+
+    auto answer = [&](const SearchServerOptions& options) {
+        std::istringstream docs_input(Join('\n', docs));
+        SearchServer srv(docs_input, options);
+        std::vector<std::istringstream> queries_inputs(4);
+        std::vector<std::ostringstream> queries_outputs(4);
+        for (size_t i = 0; i < queries_inputs.size(); ++i) {
+            queries_inputs[i].str(Join('\n', queries));
+            srv.AddQueriesStream(queries_inputs[i], queries_outputs[i]);
+        }
+        srv.Synchronize();
+
+        std::vector<std::string> results;
+        for (const auto& output : queries_outputs) {
+            results.push_back(output.str());
+        }
+        return results;
+    };
+
+    SearchServerOptions sequential;
+    sequential.threads = 1;
+    sequential.query_chunk_lines = queries.size();
+    sequential.query_cache_capacity = 0;
+    const auto expected = answer(sequential);
+
+    SearchServerOptions chunked;
+    chunked.threads = 4;
+    chunked.query_chunk_lines = 7;
+    const auto actual = answer(chunked);
+
+    // readers answer most chunks themselves, one of them on the only worker
+    SearchServerOptions bounded = chunked;
+    bounded.query_chunks_in_flight = 1;
+    const auto bounded_actual = answer(bounded);
+    bounded.threads = 1;
+    const auto single_worker = answer(bounded);
+
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQUAL(actual[i], expected[0]);
+        ASSERT_EQUAL(bounded_actual[i], expected[0]);
+        ASSERT_EQUAL(single_worker[i], expected[0]);
+        ASSERT_EQUAL(expected[i], expected[0]);
+    }
+    ASSERT_EQUAL(SplitBy(Strip(expected[0]), '\n').size(), queries.size());
+}
+
+
+void TestTokenizer() {
+    // the byte-at-a-time splitters the vectorized scanner replaced
+    auto reference_split_by = [](std::string_view sv, char sep) {
+        std::vector<std::string_view> result;
+        while (!sv.empty()) {
+            size_t sep_pos = sv.find(sep);
+            result.push_back(sv.substr(0, sep_pos));
+            sv.remove_prefix(sep_pos != sv.npos ? sep_pos + 1 : sv.size());
+        }
+        return result;
+    };
+    auto reference_split_into_words = [](std::string_view sv, char sep) {
+        auto left_strip = [&sv, sep] {
+            while (!sv.empty() && sv.front() == sep) {
+                sv.remove_prefix(1);
+            }
+        };
+        std::vector<std::string_view> result;
+        left_strip();
+        while (!sv.empty()) {
+            size_t sep_pos = sv.find(sep);
+            result.push_back(sv.substr(0, sep_pos));
+            sv.remove_prefix(sep_pos != sv.npos ? sep_pos + 1 : sv.size());
+            left_strip();
+        }
+        return result;
+    };
+
+    std::mt19937 gen(11);
+    const std::string alphabet = "ab  \t\n\r\v\f x";
+    for (size_t iteration = 0; iteration < 20000; ++iteration) {
+        // long separator and word runs cross the 16-byte blocks of the scanner
+        std::string line;
+        for (size_t length = gen() % 80; line.size() < length; ) {
+            line.append(1 + (gen() % 8 == 0 ? gen() % 40 : 0), alphabet[gen() % alphabet.size()]);
+        }
+        for (char sep : {' ', '\t', 'a'}) {
+            const auto expected = reference_split_into_words(line, sep);
+            ASSERT_EQUAL(SplitIntoWordsView(line, sep), expected);
+            ASSERT_EQUAL(SplitBy(line, sep), reference_split_by(line, sep));
+
+            size_t words_num = 0;
+            ForEachWord(line, [&](std::string_view word) {
+                ASSERT(words_num < expected.size());
+                ASSERT_EQUAL(word.data(), expected[words_num].data());
+                ASSERT_EQUAL(word.size(), expected[words_num].size());
+                ++words_num;
+            }, sep);
+            ASSERT_EQUAL(words_num, expected.size());
+        }
+    }
+}
+
+
+void TestDocumentArena() {
+    // a stream that cannot report its size, like a pipe
+    class UnseekableBuffer : public std::stringbuf {
+    public:
+        using std::stringbuf::stringbuf;
+
+    protected:
+        pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode) override {
+            return pos_type(-1);
+        }
+    };
+
+    const std::string long_line(3 << 20, 'x');
+    const std::vector<std::string> inputs = {
+        "", "\n", "\n\n", "a", "a\n", "a\nb", "a\n\nb\n", " \n  x y \n", long_line + "\nz\n" + long_line,
+    };
+    for (const auto& input : inputs) {
+        std::vector<std::string> expected;
+        std::istringstream lines(input);
+        for (std::string line; getline(lines, line); ) {
+            expected.push_back(line);
+        }
+
+        for (bool seekable : {true, false}) {
+            UnseekableBuffer unseekable(input);
+            std::istringstream seekable_input(input);
+            std::istream unseekable_input(&unseekable);
+            const InvertedIndex index(seekable ? seekable_input : unseekable_input);
+
+            ASSERT_EQUAL(index.GetDocsSize(), expected.size());
+            for (size_t docid = 0; docid < expected.size(); ++docid) {
+                ASSERT_EQUAL(index.GetDocument(docid), expected[docid]);
+            }
+        }
+    }
+
+    // a directory opens as a file, but neither its size nor its contents make sense
+    bool rejected = false;
+    try {
+        std::ifstream directory_input(std::filesystem::temp_directory_path());
+        InvertedIndex directory_index(directory_input);
+    } catch (const std::runtime_error&) {
+        rejected = true;
+    }
+    ASSERT(rejected);
+
+    InvertedIndex index;
+    index.Add("first line");
+    index.Add("");
+    index.Add("with\nnewline");
+    ASSERT_EQUAL(index.GetDocsSize(), 3u);
+    ASSERT_EQUAL(index.GetDocument(0), "first line");
+    ASSERT_EQUAL(index.GetDocument(1), "");
+    ASSERT_EQUAL(index.GetDocument(2), "with\nnewline");
+    ASSERT_EQUAL(index.Lookup("line").Size(), 1u);
+}
+
+
+void TestBinaryResults() {
+    const std::string docs = "london is the capital of great britain\n"
+                             "moscow is the capital of russia\n"
+                             "paris is the capital of france";
+    const std::string queries = "the capital\nmoscow\nberlin";
+
+    SearchServerOptions options;
+    options.result_format = ResultFormat::BINARY;
+    std::istringstream docs_input(docs);
+    SearchServer srv(docs_input, options);
+    std::istringstream queries_input(queries);
+    std::ostringstream queries_output;
+    srv.AddQueriesStream(queries_input, queries_output);
+    srv.Synchronize();
+
+    const std::string binary = queries_output.str();
+    size_t pos = 0;
+    auto read_uint32 = [&] {
+        ASSERT(pos + 4 <= binary.size());
+        uint32_t value = 0;
+        for (int byte = 0; byte < 4; ++byte) {
+            value |= uint32_t(static_cast<uint8_t>(binary[pos++])) << (8 * byte);
+        }
+        return value;
+    };
+
+    const std::vector<std::vector<std::pair<uint32_t, uint32_t>>> expected = {
+        {{0, 2}, {1, 2}, {2, 2}},
+        {{1, 1}},
+        {},
+    };
+    for (const auto& results : expected) {
+        ASSERT_EQUAL(read_uint32(), results.size());
+        for (auto [docid, hitcount] : results) {
+            ASSERT_EQUAL(read_uint32(), docid);
+            ASSERT_EQUAL(read_uint32(), hitcount);
+        }
+    }
+    ASSERT_EQUAL(pos, binary.size());
+
+    ResultWriter writer(ResultFormat::BINARY);
+    bool rejected = false;
+    try {
+        writer.Write("large", {{size_t(1) << 32, 1}});
+    } catch (const std::overflow_error&) {
+        rejected = true;
+    }
+    ASSERT(rejected);
+}
+
+
+void TestMetrics() {
+    for (uint64_t ns : {0ull, 1ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull, 1ull << 39}) {
+        const size_t index = LatencyHistogram::BucketIndex(ns);
+        ASSERT(ns <= LatencyHistogram::BucketUpperBound(index));
+        ASSERT(index == 0 || LatencyHistogram::BucketUpperBound(index - 1) < ns);
+        // at most 1/16 relative error
+        ASSERT(LatencyHistogram::BucketUpperBound(index) - ns <= ns / LatencyHistogram::SUB_BUCKETS);
+    }
+
+    Metrics metrics;
+    for (int i = 1; i <= 1000; ++i) {
+        metrics.Record(Phase::LOOKUP, microseconds(i));
+    }
+    std::thread([&metrics] {
+        metrics.Add(Counter::QUERIES, 5);
+        metrics.Record(Phase::LOOKUP, microseconds(1000));
+    }).join();
+    metrics.Add(Counter::QUERIES);
+
+    const auto lookup = metrics.Read().Get(Phase::LOOKUP);
+    ASSERT_EQUAL(metrics.Read().Get(Counter::QUERIES), 6u);
+    ASSERT_EQUAL(lookup.count, 1001u);
+    ASSERT_EQUAL(lookup.max_ns, 1000000u);
+    const uint64_t p50 = lookup.Percentile(0.5);
+    ASSERT(p50 >= 500000 && p50 <= 500000 + 500000 / 16);
+    ASSERT_EQUAL(lookup.Percentile(1), 1000000u);
+
+    const std::string docs = "london is the capital of great britain\n"
+                             "moscow is the capital of russia";
+    std::istringstream docs_input(docs);
+    SearchServer srv(docs_input);
+    std::istringstream queries_input("the capital\nmoscow\nthe capital");
+    std::ostringstream queries_output;
+    srv.AddQueriesStream(queries_input, queries_output);
+    srv.Synchronize();
+    srv.RemoveDocument(0);
+
+    const auto snapshot = srv.GetMetrics();
+    ASSERT_EQUAL(snapshot.Get(Counter::QUERIES), 3u);
+    ASSERT_EQUAL(snapshot.Get(Counter::QUERY_CACHE_HITS), 1u);
+    ASSERT_EQUAL(snapshot.Get(Counter::DOCUMENTS_REMOVED), 1u);
+    ASSERT_EQUAL(snapshot.Get(Phase::QUERY).count, 3u);
+    ASSERT_EQUAL(snapshot.Get(Phase::LOOKUP).count, 2u);
+    ASSERT_EQUAL(snapshot.Get(Phase::INDEX_BUILD).count, 1u);
+    ASSERT(snapshot.Get(Phase::FORMATTING).count >= 1);
+
+    const std::string json = snapshot.ToJson();
+    ASSERT(json.find("\"query_cache_hits\": 1") != std::string::npos);
+    ASSERT(json.find("\"lookup\": {\"count\": 2") != std::string::npos);
+    ASSERT_EQUAL(std::count(json.begin(), json.end(), '{'), std::count(json.begin(), json.end(), '}'));
+}
+
+
+void TestPostingCursor() {
+    std::mt19937 gen(17);
+    for (size_t size : {0, 1, 127, 128, 129, 1000}) {
+        for (size_t max_gap : {1, 5, 300}) {
+            std::vector<Item> items;
+            for (size_t i = 0, docid = gen() % 3; i < size; ++i, docid += 1 + gen() % max_gap) {
+                items.push_back({docid, 1 + gen() % 50});
+            }
+            std::vector<uint8_t> blocks;
+            AppendCompressedPostings(items.data(), items.size(), blocks);
+            std::vector<uint32_t> block_max_hits;
+            AppendBlockMaxHits(items.data(), items.size(), block_max_hits);
+            const uint32_t max_hits = block_max_hits.empty() ? 0 : *std::max_element(block_max_hits.begin(), block_max_hits.end());
+
+            for (bool compressed : {false, true}) {
+                PostingList list = compressed ? PostingList(blocks.data(), blocks.size(), items.size())
+                                              : PostingList(items.data(), items.size());
+                list.SetBounds(max_hits, block_max_hits.data());
+                PostingCursor cursor(list);
+
+                // random walk of Next, Advance and SkipTo with block bounds against a linear scan
+                size_t expected = 0;
+                size_t target = 0;
+                while (expected < items.size()) {
+                    ASSERT_EQUAL(cursor.Docid(), items[expected].docid);
+                    ASSERT_EQUAL(cursor.Hits(), items[expected].hits);
+                    const size_t step = gen() % 3;
+                    if (step == 0) {
+                        cursor.Next();
+                        ++expected;
+                        target = std::max(target, cursor.Docid() == PostingCursor::END ? 0 : cursor.Docid());
+                        continue;
+                    }
+                    target = std::max(target, items[expected].docid) + gen() % (2 * max_gap * 40);
+                    if (step == 2) {
+                        cursor.SkipTo(target);
+                        const uint32_t bound = cursor.BlockMaxHits();
+                        const size_t last = cursor.BlockLastDocid();
+                        ASSERT(last >= target);
+                        for (const Item& item : items) {
+                            if (item.docid >= target && item.docid <= last) {
+                                ASSERT(item.hits <= bound);
+                            }
+                        }
+                    }
+                    cursor.Advance(target);
+                    while (expected < items.size() && items[expected].docid < target) {
+                        ++expected;
+                    }
+                }
+                ASSERT_EQUAL(cursor.Docid(), PostingCursor::END);
+            }
+        }
+    }
+}
+
+
+void TestMaxScore() {
+    std::mt19937 gen(23);
+    // a few frequent words with varied hit counts and a tail of rare ones
+    auto random_document = [&] {
+        std::string document = " ";
+        for (size_t i = gen() % 12; i > 0; --i) {
+            document += (gen() % 3 == 0 ? "r" + std::to_string(gen() % 40) : "f" + std::to_string(gen() % 4)) + " ";
+        }
+        return document;
+    };
+    auto random_query = [&] {
+        std::vector<std::string> words;
+        for (size_t i = 1 + gen() % 4; i > 0; --i) {
+            words.push_back(gen() % 2 == 0 ? "r" + std::to_string(gen() % 45) : "f" + std::to_string(gen() % 5));
+        }
+        return words;
+    };
+
+    for (bool compress : {false, true}) {
+        std::vector<std::string> docs;
+        for (size_t i = 0; i < 600; ++i) {
+            docs.push_back(random_document());
+        }
+        std::istringstream base_input(Join('\n', docs));
+        SegmentedIndex index(InvertedIndex(base_input, {1, compress}));
+        for (size_t i = 0; i < 4; ++i) {
+            std::vector<std::string> batch;
+            for (size_t j = 0; j < 50 + gen() % 200; ++j) {
+                batch.push_back(random_document());
+            }
+            std::istringstream batch_input(Join('\n', batch));
+            index = index.Append(InvertedIndex(batch_input, {1, compress}));
+            if (i % 2 == 0) {
+                InvertedIndex single;
+                single.Add(random_document());
+                index = index.Append(std::move(single));
+            }
+        }
+        for (size_t i = 0; i < 100; ++i) {
+            index = index.Delete(gen() % index.GetDocsSize());
+        }
+
+        HitAccumulator accumulator;
+        for (size_t round = 0; round < 300; ++round) {
+            const std::vector<std::string> query = random_query();
+            const std::vector<std::string_view> words(query.begin(), query.end());
+            for (size_t max_docs : {1, 5, 20}) {
+                accumulator.Reset(index.GetDocsSize());
+                for (auto word : words) {
+                    index.AddHits(word, accumulator);
+                }
+                const auto expected = SelectTopDocs(accumulator, max_docs);
+                const auto actual = SelectTopDocsMaxScore(index, words, max_docs);
+
+                ASSERT_EQUAL(actual.size(), expected.size());
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    ASSERT_EQUAL(actual[i].docid, expected[i].docid);
+                    ASSERT_EQUAL(actual[i].hits, expected[i].hits);
+                }
+            }
+        }
+    }
+}
+
+
+void TestFrozenIndex() {
+    const std::vector<std::string> docs = {"the cat", "the the dog", "", "cat and   the dog", "the"};
+    InvertedIndex growing;
+    for (const auto& doc : docs) {
+        growing.Add(std::string(doc));
+    }
+    ASSERT(!growing.IsFrozen());
+
+    InvertedIndex frozen = growing;
+    frozen.Freeze();
+    ASSERT(frozen.IsFrozen());
+    InvertedIndex compressed = frozen;
+    compressed.Compress();
+    ASSERT(compressed.IsCompressed());
+
+    // a copy of a growing index grows on its own
+    InvertedIndex grown = growing;
+    grown.Add("cat");
+    ASSERT_EQUAL(grown.Lookup("cat").ToVector().size(), 3u);
+    ASSERT_EQUAL(growing.Lookup("cat").ToVector().size(), 2u);
+
+    std::istringstream document_input(Join('\n', docs));
+    ASSERT(InvertedIndex(document_input).IsFrozen());
+
+    for (const char* word : {"the", "cat", "dog", "and", "bird"}) {
+        const auto expected = growing.Lookup(word).ToVector();
+        for (const InvertedIndex* index : {&frozen, &compressed}) {
+            const PostingList list = index->Lookup(word);
+            ASSERT_EQUAL(list.MaxHits(), growing.Lookup(word).MaxHits());
+            const auto actual = list.ToVector();
+            ASSERT_EQUAL(actual.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(actual[i].docid, expected[i].docid);
+                ASSERT_EQUAL(actual[i].hits, expected[i].hits);
+            }
+        }
+    }
+
+    bool rejected = false;
+    try {
+        frozen.Add("cat");
+    } catch (const std::logic_error&) {
+        rejected = true;
+    }
+    ASSERT(rejected);
+}
+
+
+void TestQueryShards() {
+    std::mt19937 gen(19);
+    const std::vector<std::string> vocabulary = {"a", "b", "the", "of", "x"};
+    const auto docs = RandomLines(gen, vocabulary, 200, 6);
+    auto queries = RandomLines(gen, vocabulary, 100, 6);
+    queries.push_back("nothing");
+
+    auto answer = [&](size_t shards) {
+        SearchServerOptions options;
+        options.threads = 3;
+        options.query_shards = shards;
+        options.query_cache_capacity = 0;
+        std::istringstream docs_input(Join('\n', docs));
+        SearchServer srv(docs_input, options);
+        // a few more segments and deleted documents the ranges have to respect
+        for (size_t i = 0; i < 5; ++i) {
+            srv.AddDocument(docs[i]);
+        }
+        srv.RemoveDocument(3);
+        srv.RemoveDocument(150);
+        return AnswerAll(srv, queries);
+    };
+
+    const std::string expected = answer(1);
+    for (size_t shards : {2, 3, 8, 300}) {
+        ASSERT_EQUAL(answer(shards), expected);
+    }
+
+    Executor executor(3);
+    std::vector<size_t> calls(1000);
+    executor.ParallelFor(calls.size(), [&calls](size_t i) {
+        ++calls[i];
+    });
+    ASSERT(std::all_of(calls.begin(), calls.end(), [](size_t count) { return count == 1; }));
+    bool rethrown = false;
+    try {
+        executor.ParallelFor(10, [](size_t i) {
+            if (i == 7) {
+                throw std::runtime_error("range failed");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        rethrown = true;
+    }
+    ASSERT(rethrown);
+}
+
+
+void TestSearchDaemon() {
+    const std::string docs = "london is the capital of great britain\nthe river\nparis is the capital of france";
+    const std::string queries = "the capital\nriver\n\nmoscow";
+    std::istringstream docs_input(docs);
+    SearchServer srv(docs_input);
+    auto expected_answers = [&srv](const std::string& queries) {
+        std::istringstream queries_input(queries);
+        std::ostringstream queries_output;
+        srv.AddQueriesStream(queries_input, queries_output);
+        srv.Synchronize();
+        return queries_output.str();
+    };
+    const std::string expected = expected_answers(queries);
+
+    const auto directory = std::filesystem::temp_directory_path();
+    const std::string socket_path = (directory / "search_engine_test.sock").string();
+    const std::string reload_path = (directory / "search_engine_test_reload.txt").string();
+    std::ofstream(reload_path) << "the capital of the river";
+
+    auto connect_client = [&socket_path] {
+        const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        socket_path.copy(address.sun_path, socket_path.size());
+        ASSERT(connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+        return fd;
+    };
+    // sends `requests` at once and reads until the daemon has answered `lines` lines
+    auto exchange = [](int fd, const std::string& requests, size_t lines) {
+        if (!requests.empty()) {
+            ASSERT_EQUAL(static_cast<size_t>(write(fd, requests.data(), requests.size())), requests.size());
+        }
+        std::string answers;
+        char buffer[4096];
+        while (static_cast<size_t>(std::count(answers.begin(), answers.end(), '\n')) < lines) {
+            const ssize_t count = read(fd, buffer, sizeof(buffer));
+            ASSERT(count > 0);
+            answers.append(buffer, count);
+        }
+        return answers;
+    };
+
+    {
+        SearchDaemon daemon(srv, socket_path);
+        std::thread loop([&daemon] { daemon.Run(); });
+
+        // pipelined requests from two clients at once
+        const int first = connect_client();
+        const int second = connect_client();
+        std::string pipelined;
+        for (size_t i = 0; i < 50; ++i) {
+            pipelined += queries + "\n";
+        }
+        std::string expected_pipelined;
+        for (size_t i = 0; i < 50; ++i) {
+            expected_pipelined += expected;
+        }
+        ASSERT_EQUAL(exchange(first, pipelined + "!unknown\n", 201), expected_pipelined + "error: unknown command unknown\n");
+        ASSERT_EQUAL(exchange(second, queries + "\n", 4), expected);
+
+        const std::string metrics = exchange(second, "!metrics\n", 1);
+        ASSERT(metrics.find("\"queries\"") != std::string::npos);
+        const std::string memory = exchange(second, "!memory\n", 1);
+        ASSERT(memory.find("\"total\"") != std::string::npos);
+
+        ASSERT_EQUAL(exchange(first, "!reload " + reload_path + "\n", 1), "ok\n");
+        ASSERT_EQUAL(exchange(first, "!reload /nonexistent/file\n", 1), "error: cannot open /nonexistent/file\n");
+        // a directory opens but cannot be read: the reload fails, the client
+        // still gets its answer and the next ones, from the base it had
+        const std::string reloaded = exchange(first, queries + "\n", 4);
+        const std::string unreadable = exchange(first, "!reload " + directory.string() + "\n" + queries + "\n", 5);
+        ASSERT_EQUAL(unreadable.substr(0, 7), "error: ");
+        ASSERT_EQUAL(unreadable.substr(unreadable.find('\n') + 1), reloaded);
+        close(first);
+
+        // a last request without '\n' is answered before the connection closes
+        ASSERT(write(second, "river", 5) == 5);
+        shutdown(second, SHUT_WR);
+        ASSERT_EQUAL(exchange(second, "", 1), "river: {docid: 0, hitcount: 1}\n");
+        close(second);
+
+        daemon.Stop();
+        loop.join();
+    }
+    ASSERT(!std::filesystem::exists(socket_path));
+    std::filesystem::remove(reload_path);
+}
+
+
+void TestExternalBuild() {
+    std::mt19937 gen(21);
+    const std::vector<std::string> vocabulary = {"a", "b", "c", "the", "of", "x", "river", "capital"};
+    std::vector<std::string> docs(400);
+    for (auto& doc : docs) {
+        // some empty documents and some repeated words, the common ones span several blocks
+        for (size_t i = gen() % 8; i > 0; --i) {
+            doc += vocabulary[std::min(gen() % vocabulary.size(), gen() % vocabulary.size())] + " ";
+        }
+    }
+    docs.push_back("last line without a newline");
+    const std::string corpus = Join('\n', docs);
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_external.idx").string();
+    const std::vector<std::string> queries = {"the capital", "river a b", "x x of", "nothing here", "last"};
+
+    std::istringstream expected_input(corpus);
+    SearchServer expected_server(expected_input);
+    const std::string expected_answers = AnswerAll(expected_server, queries);
+
+    // a limit of one byte spills every document: more runs than one merge takes
+    for (size_t memory_limit : {size_t(1), size_t(4096), size_t(1) << 30}) {
+        for (bool compress : {false, true}) {
+            std::istringstream document_input(corpus);
+            InvertedIndex::BuildFile(document_input, path, {memory_limit, "", compress});
+            const InvertedIndex mapped = InvertedIndex::Map(path);
+            std::istringstream memory_input(corpus);
+            const InvertedIndex built(memory_input, {1, compress});
+
+            ASSERT_EQUAL(mapped.IsCompressed(), compress);
+            ASSERT_EQUAL(mapped.GetDocsSize(), built.GetDocsSize());
+            for (size_t docid = 0; docid < built.GetDocsSize(); ++docid) {
+                ASSERT_EQUAL(mapped.GetDocument(docid), built.GetDocument(docid));
+            }
+            for (const std::string& word : vocabulary) {
+                const PostingList expected = built.Lookup(word);
+                const PostingList actual = mapped.Lookup(word);
+                ASSERT_EQUAL(actual.MaxHits(), expected.MaxHits());
+                ASSERT_EQUAL(actual.BlocksNum(), expected.BlocksNum());
+                for (size_t block = 0; block < expected.BlocksNum(); ++block) {
+                    ASSERT_EQUAL(actual.BlockMaxHits(block), expected.BlockMaxHits(block));
+                }
+                const auto expected_items = expected.ToVector();
+                const auto actual_items = actual.ToVector();
+                ASSERT_EQUAL(actual_items.size(), expected_items.size());
+                for (size_t i = 0; i < expected_items.size(); ++i) {
+                    ASSERT_EQUAL(actual_items[i].docid, expected_items[i].docid);
+                    ASSERT_EQUAL(actual_items[i].hits, expected_items[i].hits);
+                }
+            }
+            ASSERT_EQUAL(mapped.Lookup("nothing").Size(), 0u);
+
+            SearchServer srv;
+            srv.LoadDocumentBase(path);
+            ASSERT_EQUAL(AnswerAll(srv, queries), expected_answers);
+        }
+    }
+
+    std::istringstream empty_input("");
+    InvertedIndex::BuildFile(empty_input, path);
+    ASSERT_EQUAL(InvertedIndex::Map(path).GetDocsSize(), 0u);
+    std::filesystem::remove(path);
+}
+
+
+void TestShardCoordinator() {
+    std::mt19937 gen(22);
+    const std::vector<std::string> vocabulary = {"a", "b", "c", "the", "of", "x", "river"};
+    const auto docs = RandomLines(gen, vocabulary, 300);
+    auto queries = RandomLines(gen, vocabulary, 2000);
+    queries.push_back("nothing");
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_shards.txt").string();
+    std::ofstream(path) << Join('\n', docs);
+
+    // the server and its threads are gone before the shards are forked
+    const std::string expected = AnswerAll(docs, queries);
+
+    // more shards than documents leaves some of them empty
+    for (size_t shards : {1, 2, 3, 7, 400}) {
+        ShardCoordinatorOptions options;
+        options.shards = shards;
+        options.server.threads = 2;
+        ShardCoordinator coordinator(path, options);
+        ASSERT_EQUAL(coordinator.GetDocsSize(), docs.size());
+
+        std::istringstream queries_input(Join('\n', queries));
+        std::ostringstream queries_output;
+        coordinator.AddQueriesStream(queries_input, queries_output);
+        ASSERT_EQUAL(queries_output.str(), expected);
+    }
+    std::filesystem::remove(path);
+}
+
+void TestDocumentReordering() {
+    // two topics on alternating lines, short lines so that many documents tie
+    std::mt19937 gen(24);
+    const std::vector<std::vector<std::string>> topics = {
+        {"river", "bank", "water", "fish", "boat"},
+        {"capital", "city", "state", "law", "court"},
+    };
+    std::vector<std::string> docs(600);
+    for (size_t docid = 0; docid < docs.size(); ++docid) {
+        const auto& words = topics[docid % 2];
+        for (size_t i = 1 + gen() % 3; i > 0; --i) {
+            docs[docid] += words[gen() % words.size()] + " ";
+        }
+    }
+    docs[7].clear();
+    const std::string corpus = Join('\n', docs);
+
+    IndexBuildOptions build_options;
+    build_options.threads = 2;
+    build_options.reorder_documents = true;
+    std::istringstream reordered_input(corpus);
+    const InvertedIndex reordered(reordered_input, build_options);
+    const uint32_t* original_docids = reordered.OriginalDocids();
+    ASSERT(original_docids != nullptr);
+    std::vector<uint32_t> seen(original_docids, original_docids + docs.size());
+    std::sort(seen.begin(), seen.end());
+    for (size_t docid = 0; docid < docs.size(); ++docid) {
+        ASSERT_EQUAL(seen[docid], docid);
+        ASSERT_EQUAL(reordered.GetDocument(docid), std::string_view(docs[original_docids[docid]]));
+    }
+    // documents of one topic end up next to each other
+    size_t topic_changes = 0;
+    for (size_t docid = 1; docid < docs.size(); ++docid) {
+        topic_changes += original_docids[docid] % 2 != original_docids[docid - 1] % 2;
+    }
+    ASSERT(topic_changes < docs.size() / 10);
+
+    std::vector<std::string> queries;
+    for (const auto& words : topics) {
+        for (size_t i = 0; i + 1 < words.size(); ++i) {
+            queries.push_back(words[i]);
+            queries.push_back(words[i] + " " + words[i + 1] + " " + topics[0][i]);
+        }
+    }
+    queries.push_back("nothing");
+    auto change = [&docs](SearchServer& srv) {
+        for (size_t docid : {3, 100, 101, 598}) {
+            srv.RemoveDocument(docid);
+        }
+        srv.AddDocument(docs[5]);
+        std::istringstream more_input(Join('\n', std::vector<std::string>(docs.begin() + 200, docs.begin() + 260)));
+        ASSERT_EQUAL(srv.AddDocuments(more_input), docs.size() + 1);
+        srv.RemoveDocument(docs.size() + 10);
+        srv.Synchronize();
+    };
+
+    // docids, and the order of ties, are those of the input whatever the scoring path
+    for (const auto& [shards, prune, max_results] : std::vector<std::tuple<size_t, bool, size_t>>{
+            {1, false, 5}, {1, false, 10}, {3, false, 20}, {1, true, 5}, {1, false, 7}}) {
+        SearchServerOptions options;
+        options.threads = 2;
+        options.query_shards = shards;
+        options.prune_queries = prune;
+        options.max_results = max_results;
+        options.segment_merge_factor = 2;
+        std::istringstream expected_input(corpus);
+        SearchServer expected_server(expected_input, options);
+        options.index_build.reorder_documents = true;
+        std::istringstream actual_input(corpus);
+        SearchServer actual_server(actual_input, options);
+        ASSERT_EQUAL(AnswerAll(actual_server, queries), AnswerAll(expected_server, queries));
+
+        change(expected_server);
+        change(actual_server);
+        ASSERT_EQUAL(AnswerAll(actual_server, queries), AnswerAll(expected_server, queries));
+    }
+
+    // the order is saved with the index
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_reordered.idx").string();
+    reordered.Save(path);
+    const InvertedIndex mapped = InvertedIndex::Map(path);
+    ASSERT(mapped.OriginalDocids() != nullptr);
+    ASSERT(std::equal(original_docids, original_docids + docs.size(), mapped.OriginalDocids()));
+    SearchServer mapped_server;
+    mapped_server.LoadDocumentBase(path);
+    std::istringstream expected_input(corpus);
+    SearchServer expected_server(expected_input);
+    ASSERT_EQUAL(AnswerAll(mapped_server, queries), AnswerAll(expected_server, queries));
+    std::filesystem::remove(path);
+
+    std::istringstream plain_input(corpus);
+    ASSERT(InvertedIndex(plain_input).OriginalDocids() == nullptr);
+}
+
+void TestMemoryUsage() {
+    std::mt19937 gen(25);
+    auto make_corpus = [&gen](size_t docs_num) {
+        std::vector<std::string> docs(docs_num);
+        for (auto& doc : docs) {
+            for (size_t i = 1 + gen() % 8; i > 0; --i) {
+                doc += "w" + std::to_string(std::min(gen() % 500, gen() % 500)) + " ";
+            }
+        }
+        return Join('\n', docs);
+    };
+    const std::string corpus = make_corpus(3000);
+    const std::vector<std::string> queries = {"w0 w1", "w7 w7 w30", "w499", "nothing"};
+    auto rejected = [](const std::function<void()>& func) {
+        try {
+            func();
+        } catch (const std::runtime_error&) {
+            return true;
+        }
+        return false;
+    };
+
+    std::istringstream plain_input(corpus);
+    const InvertedIndex plain(plain_input);
+    const IndexMemoryUsage usage = plain.GetMemoryUsage();
+    ASSERT(usage.documents >= corpus.size());
+    ASSERT(usage.dictionary > 0);
+    ASSERT(usage.postings > 0);
+    ASSERT_EQUAL(usage.mapped, 0u);
+    ASSERT_EQUAL(usage.Total(), usage.dictionary + usage.postings + usage.documents);
+
+    std::istringstream compressed_input(corpus);
+    const IndexMemoryUsage compressed = InvertedIndex(compressed_input, {1, true}).GetMemoryUsage();
+    ASSERT(compressed.postings < usage.postings);
+    ASSERT_EQUAL(compressed.dictionary, usage.dictionary);
+    ASSERT_EQUAL(compressed.documents, usage.documents);
+
+    // a mapped index keeps next to nothing on the heap
+    const std::string path = (std::filesystem::temp_directory_path() / "search_engine_memory.idx").string();
+    plain.Save(path);
+    const IndexMemoryUsage mapped = InvertedIndex::Map(path).GetMemoryUsage();
+    ASSERT_EQUAL(mapped.mapped, std::filesystem::file_size(path));
+    ASSERT(mapped.Total() < 1024);
+    std::filesystem::remove(path);
+
+    // builds stop at the limit, on one thread or several
+    for (size_t threads : {1, 3}) {
+        IndexBuildOptions options;
+        options.threads = threads;
+        for (size_t memory_limit : {corpus.size() / 2, usage.Total() / 2, usage.Total() + usage.postings / 2}) {
+            options.memory_limit = memory_limit;
+            ASSERT(rejected([&] {
+                std::istringstream document_input(corpus);
+                InvertedIndex index(document_input, options);
+            }));
+        }
+        // freezing holds the posting vectors and the frozen copy at once
+        options.memory_limit = 3 * usage.Total();
+        std::istringstream document_input(corpus);
+        const InvertedIndex index(document_input, options);
+        ASSERT(index.GetMemoryUsage().Total() <= options.memory_limit);
+    }
+
+    SearchServerOptions options;
+    options.threads = 2;
+    options.index_build.threads = 1;
+    options.segment_merge_factor = 2;
+    std::istringstream expected_input(corpus);
+    SearchServer expected_server(expected_input, options);
+    const std::string expected = AnswerAll(expected_server, queries);
+    const ServerMemoryUsage server_usage = expected_server.GetMemoryUsage();
+    ASSERT_EQUAL(server_usage.index.Total(), usage.Total());
+    // every worker that answered a query holds counters for the whole base
+    ASSERT(server_usage.query_scratch >= 3000 * (sizeof(size_t) + sizeof(uint32_t)));
+    ASSERT(server_usage.query_cache > 0);
+    ASSERT_EQUAL(server_usage.query_scratch, expected_server.GetMetrics().Get(Gauge::QUERY_SCRATCH_BYTES));
+    ASSERT(server_usage.ToJson().find("\"total\": " + std::to_string(server_usage.Total())) != std::string::npos);
+
+    // nothing left for a base
+    options.memory_budget = 1;
+    ASSERT(rejected([&] {
+        std::istringstream document_input(corpus);
+        SearchServer srv(document_input, options);
+    }));
+
+    // room for the base, not for a second one next to it
+    options.memory_budget = 4 * usage.Total();
+    std::istringstream document_input(corpus);
+    SearchServer srv(document_input, options);
+    ASSERT_EQUAL(AnswerAll(srv, queries), expected);
+    const std::string larger = make_corpus(12000);
+    std::istringstream larger_input(larger);
+    srv.UpdateDocumentBase(larger_input);
+    ASSERT(rejected([&] {
+        srv.Synchronize();
+    }));
+    ASSERT_EQUAL(AnswerAll(srv, queries), expected);
+
+    const std::string larger_path = (std::filesystem::temp_directory_path() / "search_engine_memory.txt").string();
+    std::ofstream(larger_path) << larger;
+    std::string error;
+    srv.UpdateDocumentBase(larger_path, [&error](std::string reason) {
+        error = std::move(reason);
+    });
+    srv.Synchronize();
+    ASSERT(error.find("memory limit") != std::string::npos);
+    std::filesystem::remove(larger_path);
+
+    std::istringstream larger_batch_input(larger);
+    ASSERT(rejected([&] {
+        srv.AddDocuments(larger_batch_input);
+    }));
+
+    // a second copy fits next to the base, merging the two would not: the merge waits
+    for (SearchServer* server : {&srv, &expected_server}) {
+        std::istringstream batch_input(corpus);
+        ASSERT_EQUAL(server->AddDocuments(batch_input), 3000u);
+        server->Synchronize();
+    }
+    ASSERT(srv.GetMetrics().Get(Counter::SEGMENT_MERGES_DEFERRED) > 0);
+    ASSERT_EQUAL(srv.GetMetrics().Get(Counter::SEGMENT_MERGES), 0u);
+    ASSERT_EQUAL(expected_server.GetMetrics().Get(Counter::SEGMENT_MERGES), 1u);
+    ASSERT_EQUAL(AnswerAll(srv, queries), AnswerAll(expected_server, queries));
+    ASSERT(srv.GetMemoryUsage().Total() <= options.memory_budget);
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// RCU-style holder of an immutable value. A writer builds a complete new value
+// and publishes it atomically, so readers never wait for a rebuild. Acquire()
+// is an atomic load of a shared_ptr: libstdc++ guards it with a spinlock from
+// a small shared pool, held only to copy the pointer and bump its count, so
+// readers are not lock-free but never wait on a writer's work. Every published
+// value gets its own generation number, and an old value is destroyed when the
+// last snapshot of it is dropped.
+template<typename T>
+class Versioned {
+public:
+    struct Version {
+        T value;
+        uint64_t generation;
+    };
+
+    using Snapshot = std::shared_ptr<const Version>;
+
+    explicit Versioned(T initial = T()) :
+            current(std::make_shared<const Version>(Version{std::move(initial), 0}))
+    {
+    }
+
+    Snapshot Acquire() const {
+        return std::atomic_load_explicit(&current, std::memory_order_acquire);
+    }
+
+    uint64_t Generation() const {
+        return generation.load(std::memory_order_acquire);
+    }
+
+    void Publish(T value) {
+        std::lock_guard<std::mutex> guard(writer);
+        PublishLocked(std::move(value));
+    }
+
+    // Copy-modify-publish: `modify` gets the latest value and returns the next one.
+    // Concurrent updates are serialized, so none of them is lost.
+    template<typename Modify>
+    void Update(Modify modify) {
+        std::lock_guard<std::mutex> guard(writer);
+        PublishLocked(modify(Acquire()->value));
+    }
+
+    // Like Update, but `modify` returns std::optional<T> and nullopt publishes nothing.
+    template<typename Modify>
+    bool TryUpdate(Modify modify) {
+        std::lock_guard<std::mutex> guard(writer);
+        auto next = modify(Acquire()->value);
+        if (!next) {
+            return false;
+        }
+        PublishLocked(std::move(*next));
+        return true;
+    }
+
+private:
+    void PublishLocked(T value) {
+        const uint64_t next = Generation() + 1;
+        std::atomic_store_explicit(&current,
+                                   std::make_shared<const Version>(Version{std::move(value), next}),
+                                   std::memory_order_release);
+        generation.store(next, std::memory_order_release);
+    }
+
+    Snapshot current;
+    std::atomic<uint64_t> generation = 0;
+    std::mutex writer;
+};